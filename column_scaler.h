@@ -0,0 +1,109 @@
+#pragma once
+
+// Wolf3D-style precomputed column scalers. For a wall slice of a given
+// lineHeight, the texel row of every visible screen row is the same every
+// time, so it is computed once into a table and the wall loop becomes a
+// plain gather-and-store. Tables are built lazily by whichever render thread
+// first needs them and published lock-free. The cache has a byte budget;
+// once it is spent, uncached heights fall back to 16.16 fixed-point stepping.
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+
+// Counters for sizing the cache budget
+struct ScalerCacheStats {
+    long long hits;       // Columns drawn from an existing table
+    long long builds;     // Tables built
+    long long fallbacks;  // Columns stepped in fixed point because the budget was spent
+    size_t bytes;         // Memory held by tables
+    size_t budget;
+};
+
+class ColumnScalerCache {
+private:
+    int textureSize;
+    std::unique_ptr<std::atomic<const uint16_t*>[]> tables;  // Indexed by lineHeight
+    int maxLineHeight;
+    size_t budget;
+    std::atomic<size_t> bytes;
+    std::atomic<long long> hits, builds, fallbacks;
+
+public:
+    ColumnScalerCache() : textureSize(0), maxLineHeight(-1), budget(0), bytes(0), hits(0), builds(0), fallbacks(0) {}
+
+    ~ColumnScalerCache() {
+        clear();
+    }
+
+    // Prepare for wall heights 0..maxHeight of a texture textureSize texels tall
+    void init(int texSize, int maxHeight, size_t budgetBytes) {
+        clear();
+        textureSize = texSize;
+        maxLineHeight = maxHeight;
+        budget = budgetBytes;
+        hits = 0;
+        builds = 0;
+        fallbacks = 0;
+        tables.reset(new std::atomic<const uint16_t*>[maxHeight + 1]);
+        for (int i = 0; i <= maxHeight; i++) {
+            tables[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    // Drop every table, keeping the counters. Needed whenever the slice row
+    // counts change (a new view height), since a table is only valid for one.
+    void clear() {
+        for (int i = 0; i <= maxLineHeight; i++) {
+            delete[] tables[i].exchange(NULL);
+        }
+        bytes = 0;
+    }
+
+    // Texel row for each of the first `count` rows of a slice lineHeight pixels
+    // tall, or NULL if it isn't cached and the budget doesn't allow building it.
+    // count must be the same every time for a given lineHeight.
+    const uint16_t* get(int lineHeight, int count) {
+        if (lineHeight < 0 || lineHeight > maxLineHeight) return NULL;
+        const uint16_t* table = tables[lineHeight].load(std::memory_order_acquire);
+        if (table) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return table;
+        }
+
+        size_t size = sizeof(uint16_t) * std::max(count, 1);
+        if (bytes.fetch_add(size, std::memory_order_relaxed) + size > budget) {
+            bytes.fetch_sub(size, std::memory_order_relaxed);
+            fallbacks.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+
+        uint16_t* built = new uint16_t[std::max(count, 1)];
+        for (int i = 0; i < count; i++) {
+            built[i] = uint16_t(int((float)i / lineHeight * textureSize));
+        }
+
+        // Another thread may have built the same table meanwhile; keep theirs
+        const uint16_t* expected = NULL;
+        if (!tables[lineHeight].compare_exchange_strong(expected, built, std::memory_order_acq_rel)) {
+            delete[] built;
+            bytes.fetch_sub(size, std::memory_order_relaxed);
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return expected;
+        }
+        builds.fetch_add(1, std::memory_order_relaxed);
+        return built;
+    }
+
+    ScalerCacheStats stats() const {
+        ScalerCacheStats result;
+        result.hits = hits.load();
+        result.builds = builds.load();
+        result.fallbacks = fallbacks.load();
+        result.bytes = bytes.load();
+        result.budget = budget;
+        return result;
+    }
+};
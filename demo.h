@@ -0,0 +1,151 @@
+#pragma once
+
+// Demos: a level recipe plus the input of every update, for replaying a run
+// exactly. A demo starts from a generated level, so the recipe is just the
+// seed, the map size, the enemy count and whether enemies pathfind; given
+// those, a fresh Game builds the same level anywhere (Game::setSeed). Each
+// recorded update also keeps Game::stateChecksum() as it stood afterwards, so
+// a replay can tell at which update, if any, it stopped matching.
+//
+// Replays only match when both runs search paths inside update(), as
+// startLevel() arranges: a threaded search finishes whenever the scheduler
+// lets it, and enemies would take up new paths on different updates.
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "engine.h"
+
+const char DEMO_FILE_MAGIC[8] = { 'R', 'C', 'D', 'E', 'M', 'O', '0', '1' };
+
+// Bits of DemoTick::buttons
+const uint32_t DEMO_FORWARD = 1;
+const uint32_t DEMO_BACKWARD = 2;
+const uint32_t DEMO_STRAFE_LEFT = 4;
+const uint32_t DEMO_STRAFE_RIGHT = 8;
+const uint32_t DEMO_FIRE = 16;
+
+// Bits of DemoHeader::flags
+const uint32_t DEMO_PATHFINDING = 1;
+
+// File layout: the header, then `ticks` DemoTicks. Little-endian.
+struct DemoHeader {
+    char magic[8];
+    uint32_t seed;
+    int32_t mapWidth, mapHeight;
+    int32_t enemyCount;
+    uint32_t flags;
+    uint32_t ticks;
+};
+
+struct DemoTick {
+    uint64_t checksum;  // Game::stateChecksum() after this update
+    float turn;
+    uint32_t buttons;
+};
+
+class Demo {
+private:
+    DemoHeader header;
+    std::vector<DemoTick> ticks;
+
+public:
+    Demo() {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, DEMO_FILE_MAGIC, sizeof(DEMO_FILE_MAGIC));
+    }
+
+    // Start an empty recording of the level these settings generate
+    void begin(uint32_t seed, int mapWidth, int mapHeight, int enemyCount, bool pathfinding) {
+        header.seed = seed;
+        header.mapWidth = mapWidth;
+        header.mapHeight = mapHeight;
+        header.enemyCount = enemyCount;
+        header.flags = pathfinding ? DEMO_PATHFINDING : 0;
+        ticks.clear();
+    }
+
+    // Build the demo's level in a freshly constructed game, searching paths
+    // inside update() so replays repeat. Returns false if the level can't be
+    // generated.
+    bool startLevel(Game& game) const {
+        game.setPathfinding((header.flags & DEMO_PATHFINDING) != 0);
+        game.setPathfindingThreaded(false);
+        game.setEnemyCount(header.enemyCount);
+        game.setSeed(header.seed);
+        return game.generateMap(header.mapWidth, header.mapHeight);
+    }
+
+    // Append an update: the input it was given and the state it left
+    void record(const InputState& input, uint64_t checksum) {
+        DemoTick tick;
+        tick.checksum = checksum;
+        tick.turn = input.turn;
+        tick.buttons = (input.forward ? DEMO_FORWARD : 0) | (input.backward ? DEMO_BACKWARD : 0) |
+                       (input.strafeLeft ? DEMO_STRAFE_LEFT : 0) | (input.strafeRight ? DEMO_STRAFE_RIGHT : 0) |
+                       (input.fire ? DEMO_FIRE : 0);
+        ticks.push_back(tick);
+    }
+
+    int getTicks() const { return int(ticks.size()); }
+    uint32_t getSeed() const { return header.seed; }
+    int getMapWidth() const { return header.mapWidth; }
+    int getMapHeight() const { return header.mapHeight; }
+    int getEnemyCount() const { return header.enemyCount; }
+
+    // Input of update i
+    InputState input(int i) const {
+        InputState state;
+        uint32_t buttons = ticks[i].buttons;
+        state.forward = (buttons & DEMO_FORWARD) != 0;
+        state.backward = (buttons & DEMO_BACKWARD) != 0;
+        state.strafeLeft = (buttons & DEMO_STRAFE_LEFT) != 0;
+        state.strafeRight = (buttons & DEMO_STRAFE_RIGHT) != 0;
+        state.fire = (buttons & DEMO_FIRE) != 0;
+        state.turn = ticks[i].turn;
+        return state;
+    }
+
+    // State checksum the recording had after update i
+    uint64_t checksum(int i) const { return ticks[i].checksum; }
+
+    bool save(const char* path) {
+        FILE* file = fopen(path, "wb");
+        if (!file) return false;
+        header.ticks = uint32_t(ticks.size());
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(ticks.data(), sizeof(DemoTick), ticks.size(), file) == ticks.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    // Read a demo written by save(). Returns false, leaving this demo as it
+    // was, if the file can't be read, isn't a demo or doesn't hold exactly the
+    // ticks its header counts.
+    bool load(const char* path) {
+        FILE* file = fopen(path, "rb");
+        if (!file) return false;
+        DemoHeader loaded;
+        bool ok = fread(&loaded, sizeof(loaded), 1, file) == 1 &&
+                  memcmp(loaded.magic, DEMO_FILE_MAGIC, sizeof(DEMO_FILE_MAGIC)) == 0 &&
+                  loaded.mapWidth > 0 && loaded.mapHeight > 0 && loaded.enemyCount >= 0;
+        // The tick count must match what the file holds before anything is allocated for it
+        if (ok) {
+            long headerEnd = ftell(file);
+            ok = headerEnd >= 0 && fseek(file, 0, SEEK_END) == 0;
+            long fileEnd = ok ? ftell(file) : -1;
+            ok = ok && fileEnd >= headerEnd && fseek(file, headerEnd, SEEK_SET) == 0 &&
+                 (unsigned long long)(fileEnd - headerEnd) == (unsigned long long)loaded.ticks * sizeof(DemoTick);
+        }
+        std::vector<DemoTick> loadedTicks;
+        if (ok) {
+            loadedTicks.resize(loaded.ticks);
+            ok = fread(loadedTicks.data(), sizeof(DemoTick), loadedTicks.size(), file) == loadedTicks.size();
+        }
+        fclose(file);
+        if (!ok) return false;
+        header = loaded;
+        ticks.swap(loadedTicks);
+        return true;
+    }
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+// Uniform grid over the map for finding enemies by position. Each bucket
+// covers ENEMY_GRID_CELLS x ENEMY_GRID_CELLS map cells and holds its enemies
+// in an intrusive doubly linked list, so moving an enemy to another bucket,
+// or taking a dead one out, is O(1) and nothing is rebuilt per frame.
+// Queries then touch only the buckets around a point, along a shot or along
+// the view, however many enemies the level has.
+//
+// View queries mark buckets rather than returning enemies: the caller marks
+// the buckets each ray crossed, and every marked bucket is listed once.
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+const int ENEMY_GRID_SHIFT = 2;
+const int ENEMY_GRID_CELLS = 1 << ENEMY_GRID_SHIFT; // Map cells per bucket side
+
+class EnemyGrid {
+private:
+    int bucketsX, bucketsY;
+    std::vector<int> head;          // First enemy in each bucket, -1 if none
+    std::vector<int> next, prev;    // Neighbours in the bucket's list, per enemy
+    std::vector<int> bucketOf;      // Bucket of each enemy, -1 if not in the grid
+    std::vector<int> markEpoch;     // Bucket is marked if its entry equals epoch
+    std::vector<int> marked;        // Buckets marked since beginMarking()
+    std::vector<int> segmentBuckets; // Scratch for forEachAlongSegment()
+    int epoch;
+
+    int clampX(int bx) const { return std::max(0, std::min(bx, bucketsX - 1)); }
+    int clampY(int by) const { return std::max(0, std::min(by, bucketsY - 1)); }
+
+    void link(int id, int bucket) {
+        bucketOf[id] = bucket;
+        prev[id] = -1;
+        next[id] = head[bucket];
+        if (next[id] >= 0) prev[next[id]] = id;
+        head[bucket] = id;
+    }
+
+    void unlink(int id) {
+        int bucket = bucketOf[id];
+        if (prev[id] >= 0) next[prev[id]] = next[id];
+        else head[bucket] = next[id];
+        if (next[id] >= 0) prev[next[id]] = prev[id];
+        bucketOf[id] = -1;
+    }
+
+public:
+    EnemyGrid() : bucketsX(0), bucketsY(0), epoch(0) {}
+
+    // Empty the grid and size it for a map and up to `enemies` enemy ids
+    void reset(int mapWidth, int mapHeight, int enemies) {
+        bucketsX = (mapWidth + ENEMY_GRID_CELLS - 1) >> ENEMY_GRID_SHIFT;
+        bucketsY = (mapHeight + ENEMY_GRID_CELLS - 1) >> ENEMY_GRID_SHIFT;
+        head.assign(size_t(bucketsX) * bucketsY, -1);
+        markEpoch.assign(head.size(), -1);
+        next.assign(enemies, -1);
+        prev.assign(enemies, -1);
+        bucketOf.assign(enemies, -1);
+        marked.clear();
+        epoch = 0;
+    }
+
+    // Bucket holding map position (x, y); positions off the map go to the nearest edge bucket
+    int bucketAt(float x, float y) const {
+        return clampX(int(std::floor(x)) >> ENEMY_GRID_SHIFT) * bucketsY + clampY(int(std::floor(y)) >> ENEMY_GRID_SHIFT);
+    }
+
+    void insert(int id, float x, float y) { link(id, bucketAt(x, y)); }
+
+    void remove(int id) {
+        if (bucketOf[id] >= 0) unlink(id);
+    }
+
+    // Follow an enemy to (x, y), relinking it only if it changed bucket
+    void move(int id, float x, float y) {
+        int bucket = bucketAt(x, y);
+        if (bucket == bucketOf[id]) return;
+        unlink(id);
+        link(id, bucket);
+    }
+
+    // Call fn(id) for every enemy in the buckets overlapping the square of
+    // half-width radius around (x, y)
+    template <typename Fn>
+    void forEachNear(float x, float y, float radius, Fn fn) const {
+        int bx0 = clampX(int(std::floor(x - radius)) >> ENEMY_GRID_SHIFT);
+        int bx1 = clampX(int(std::floor(x + radius)) >> ENEMY_GRID_SHIFT);
+        int by0 = clampY(int(std::floor(y - radius)) >> ENEMY_GRID_SHIFT);
+        int by1 = clampY(int(std::floor(y + radius)) >> ENEMY_GRID_SHIFT);
+        for (int bx = bx0; bx <= bx1; bx++) {
+            for (int by = by0; by <= by1; by++) {
+                forEachInBucket(bx * bucketsY + by, fn);
+            }
+        }
+    }
+
+    template <typename Fn>
+    void forEachInBucket(int bucket, Fn fn) const {
+        for (int id = head[bucket]; id >= 0; id = next[id]) fn(id);
+    }
+
+    // Start a new set of marked buckets
+    void beginMarking() {
+        epoch++;
+        marked.clear();
+    }
+
+    // Call fn(bx, by) for each bucket the segment (x0, y0)-(x1, y1) passes through
+    template <typename Fn>
+    void walkSegment(float x0, float y0, float x1, float y1, Fn fn) const {
+        float scale = 1.0f / ENEMY_GRID_CELLS;
+        x0 *= scale; y0 *= scale; x1 *= scale; y1 *= scale;
+        int bx = int(std::floor(x0)), by = int(std::floor(y0));
+        int endX = int(std::floor(x1)), endY = int(std::floor(y1));
+        float dirX = x1 - x0, dirY = y1 - y0;
+
+        // DDA over buckets, as in the wall caster, until the end bucket
+        float deltaX = dirX == 0 ? 1e30f : std::abs(1.0f / dirX);
+        float deltaY = dirY == 0 ? 1e30f : std::abs(1.0f / dirY);
+        int stepX = dirX < 0 ? -1 : 1, stepY = dirY < 0 ? -1 : 1;
+        float sideX = (dirX < 0 ? x0 - bx : bx + 1.0f - x0) * deltaX;
+        float sideY = (dirY < 0 ? y0 - by : by + 1.0f - y0) * deltaY;
+        int steps = std::abs(endX - bx) + std::abs(endY - by);
+        fn(bx, by);
+        for (int i = 0; i < steps; i++) {
+            if (sideX < sideY) {
+                sideX += deltaX;
+                bx += stepX;
+            } else {
+                sideY += deltaY;
+                by += stepY;
+            }
+            fn(bx, by);
+        }
+    }
+
+    // Mark the buckets the segment (x0, y0)-(x1, y1) passes through, and their
+    // neighbours, so enemies whose sprites overlap the segment are found even
+    // if their centres lie just beside it
+    void markSegment(float x0, float y0, float x1, float y1) {
+        walkSegment(x0, y0, x1, y1, [&](int bx, int by) { markAround(bx, by); });
+    }
+
+    // Call fn(id) once for every enemy in the buckets along the segment
+    // (x0, y0)-(x1, y1) and their neighbours. Leaves the marks alone.
+    template <typename Fn>
+    void forEachAlongSegment(float x0, float y0, float x1, float y1, Fn fn) {
+        segmentBuckets.clear();
+        walkSegment(x0, y0, x1, y1, [&](int bx, int by) {
+            for (int x = clampX(bx - 1); x <= clampX(bx + 1); x++) {
+                for (int y = clampY(by - 1); y <= clampY(by + 1); y++) {
+                    segmentBuckets.push_back(x * bucketsY + y);
+                }
+            }
+        });
+        std::sort(segmentBuckets.begin(), segmentBuckets.end());
+        segmentBuckets.erase(std::unique(segmentBuckets.begin(), segmentBuckets.end()), segmentBuckets.end());
+        for (int bucket : segmentBuckets) forEachInBucket(bucket, fn);
+    }
+
+    // Mark bucket (bx, by) and its eight neighbours
+    void markAround(int bx, int by) {
+        for (int x = clampX(bx - 1); x <= clampX(bx + 1); x++) {
+            for (int y = clampY(by - 1); y <= clampY(by + 1); y++) {
+                int bucket = x * bucketsY + y;
+                if (markEpoch[bucket] == epoch) continue;
+                markEpoch[bucket] = epoch;
+                marked.push_back(bucket);
+            }
+        }
+    }
+
+    const std::vector<int>& markedBuckets() const { return marked; }
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+// Live enemies as a structure of arrays, and the batch update that walks them
+// toward the player. Positions, speeds and health sit in their own arrays, so
+// the update streams through exactly the fields it needs and the AVX2 kernel
+// loads eight enemies per instruction. Dead enemies don't stay behind as
+// flagged entries: the last enemy moves into the hole, so every pass touches
+// only the living.
+//
+// Enemies follow a shared flow field (flow_field.h) when they stand in a cell
+// it reached, heading for the centre of the next cell on the path, and walk
+// straight at the player otherwise.
+//
+// Both kernels perform the same float operations in the same order, as the
+// wall casters do, so they move enemies identically. That holds only while
+// the compiler rounds every multiply and add on its own: gnu++17 lets GCC fuse
+// them into FMAs on FMA targets (-ffp-contract=fast), which would change the
+// scalar kernel's results and not the intrinsics'. ENEMY_EXACT_FP turns
+// contraction off for both kernels. Enemies never leave the
+// map, whose solid border (world_map.h) stops them, so wall tests are one bit
+// lookup with no bounds checks.
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include "world_map.h"
+#include "raycast.h"
+#include "flow_field.h"
+
+#if defined(__clang__)
+#define ENEMY_EXACT_FP
+#define ENEMY_EXACT_FP_BODY _Pragma("clang fp contract(off)")
+#elif defined(__GNUC__)
+#define ENEMY_EXACT_FP __attribute__((optimize("fp-contract=off")))
+#define ENEMY_EXACT_FP_BODY
+#else
+#define ENEMY_EXACT_FP
+#define ENEMY_EXACT_FP_BODY
+#endif
+
+const float ENEMY_SPEED = 0.015f;     // Map cells walked per update
+const int ENEMY_HEALTH = 50;
+const float ENEMY_CONTACT_RANGE = 0.5f; // Closer than this an enemy stops and hurts the player
+const int ENEMY_CONTACT_UPDATES = 2;    // Updates of contact per point of damage
+
+struct EnemyStore {
+    std::vector<float> x, y;
+    std::vector<float> speed;
+    std::vector<int> health;
+    std::vector<uint32_t> tag; // Spawn number: unlike the index, it stays with the enemy
+    uint32_t nextTag;
+
+    EnemyStore() : nextTag(0) {}
+
+    int size() const { return int(x.size()); }
+
+    void clear() {
+        x.clear();
+        y.clear();
+        speed.clear();
+        health.clear();
+        tag.clear();
+        nextTag = 0;
+    }
+
+    void add(float px, float py) {
+        x.push_back(px);
+        y.push_back(py);
+        speed.push_back(ENEMY_SPEED);
+        health.push_back(ENEMY_HEALTH);
+        tag.push_back(nextTag++);
+    }
+
+    // Remove enemy i by moving the last enemy into its slot. Returns the old
+    // index of the enemy now at i, or -1 if i was the last one.
+    int removeAt(int i) {
+        int last = size() - 1;
+        int moved = -1;
+        if (i != last) {
+            x[i] = x[last];
+            y[i] = y[last];
+            speed[i] = speed[last];
+            health[i] = health[last];
+            tag[i] = tag[last];
+            moved = last;
+        }
+        x.pop_back();
+        y.pop_back();
+        speed.pop_back();
+        health.pop_back();
+        tag.pop_back();
+        return moved;
+    }
+};
+
+// Map and player shared by every enemy of an update
+struct EnemyUpdateParams {
+    const uint32_t* solid;  // Occupancy bits, as in RayCastParams
+    int mapChunksY;
+    float playerX, playerY;
+    const FlowField* flow;  // Paths to the player, or NULL to walk straight at them
+};
+
+// Offset from a cell's corner to the centre of the next cell in each flow direction
+const float FLOW_STEP_X[8] = {1.5f, -0.5f, 0.5f, 0.5f, 1.5f, -0.5f, 1.5f, -0.5f};
+const float FLOW_STEP_Y[8] = {0.5f, 0.5f, 1.5f, -0.5f, 1.5f, -0.5f, -0.5f, 1.5f};
+
+// Move enemies [begin, end) one step toward the player, each axis on its own
+// so they slide along walls, and return how many end up within
+// ENEMY_CONTACT_RANGE of the player. Enemies that stepped into another map
+// cell are appended to crossed; only they can have changed grid bucket.
+ENEMY_EXACT_FP
+inline int updateEnemiesScalar(EnemyStore& e, const EnemyUpdateParams& p, int begin, int end, std::vector<int>& crossed) {
+    ENEMY_EXACT_FP_BODY
+    const uint32_t* solid = p.solid;
+    int chunksY = p.mapChunksY;
+    float playerX = p.playerX, playerY = p.playerY;
+    int contacts = 0;
+    for (int i = begin; i < end; i++) {
+        float x = e.x[i], y = e.y[i];
+        float dx = playerX - x, dy = playerY - y;
+        float dist = std::sqrt(dx * dx + dy * dy);
+        if (dist > ENEMY_CONTACT_RANGE) {
+            // Head for the next cell on the flow field's path, if there is one
+            if (p.flow) {
+                int cellX = int(x), cellY = int(y);
+                int dir = p.flow->at(cellX, cellY);
+                if (dir < FLOW_TARGET) {
+                    dx = float(cellX) + FLOW_STEP_X[dir] - x;
+                    dy = float(cellY) + FLOW_STEP_Y[dir] - y;
+                    dist = std::sqrt(dx * dx + dy * dy);
+                }
+            }
+            float newX = x + dx / dist * e.speed[i];
+            float newY = y + dy / dist * e.speed[i];
+            if (!mapSolid(solid, int(newX), int(y), chunksY)) x = newX;
+            if (!mapSolid(solid, int(x), int(newY), chunksY)) y = newY;
+            if (std::floor(x) != std::floor(e.x[i]) || std::floor(y) != std::floor(e.y[i])) crossed.push_back(i);
+            e.x[i] = x;
+            e.y[i] = y;
+        }
+        dx = playerX - x;
+        dy = playerY - y;
+        if (std::sqrt(dx * dx + dy * dy) < ENEMY_CONTACT_RANGE) contacts++;
+    }
+    return contacts;
+}
+
+#ifdef RAYCAST_X86_SIMD
+
+// Eight enemies per iteration, the rest with the scalar kernel. Wall tests
+// gather occupancy bits the way the AVX2 ray caster does.
+__attribute__((target("avx2"))) ENEMY_EXACT_FP
+inline int updateEnemiesAVX2(EnemyStore& e, const EnemyUpdateParams& p, int begin, int end, std::vector<int>& crossed) {
+    ENEMY_EXACT_FP_BODY
+    const uint32_t* solid = p.solid;
+    int chunksY = p.mapChunksY;
+    const __m256 px = _mm256_set1_ps(p.playerX);
+    const __m256 py = _mm256_set1_ps(p.playerY);
+    const __m256 stepX = _mm256_loadu_ps(FLOW_STEP_X);
+    const __m256 stepY = _mm256_loadu_ps(FLOW_STEP_Y);
+    const __m256 range = _mm256_set1_ps(ENEMY_CONTACT_RANGE);
+    const __m256i zero = _mm256_setzero_si256();
+    int contacts = 0;
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(&e.x[i]);
+        __m256 y = _mm256_loadu_ps(&e.y[i]);
+        __m256 speed = _mm256_loadu_ps(&e.speed[i]);
+        __m256 dx = _mm256_sub_ps(px, x);
+        __m256 dy = _mm256_sub_ps(py, y);
+        __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+        __m256i walk = _mm256_castps_si256(_mm256_cmp_ps(dist, range, _CMP_GT_OQ));
+
+        // Gather the flow field entries of walking lanes inside its window, one byte per cell
+        if (p.flow) {
+            __m256i cellX = _mm256_cvttps_epi32(x);
+            __m256i cellY = _mm256_cvttps_epi32(y);
+            __m256i fieldX = _mm256_sub_epi32(cellX, _mm256_set1_epi32(p.flow->originX));
+            __m256i fieldY = _mm256_sub_epi32(cellY, _mm256_set1_epi32(p.flow->originY));
+            __m256i inside = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpgt_epi32(fieldX, _mm256_set1_epi32(-1)), _mm256_cmpgt_epi32(_mm256_set1_epi32(p.flow->width), fieldX)),
+                _mm256_and_si256(_mm256_cmpgt_epi32(fieldY, _mm256_set1_epi32(-1)), _mm256_cmpgt_epi32(_mm256_set1_epi32(p.flow->height), fieldY)));
+            __m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(fieldX, _mm256_set1_epi32(p.flow->height)), fieldY);
+            __m256i dir = _mm256_and_si256(_mm256_mask_i32gather_epi32(_mm256_set1_epi32(FLOW_NONE), (const int*)p.flow->next.data(),
+                                                                       cell, _mm256_and_si256(walk, inside), 1),
+                                           _mm256_set1_epi32(0xFF));
+            __m256 follow = _mm256_castsi256_ps(_mm256_and_si256(walk, _mm256_cmpgt_epi32(_mm256_set1_epi32(FLOW_TARGET), dir)));
+            __m256 flowX = _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(cellX), _mm256_permutevar8x32_ps(stepX, dir)), x);
+            __m256 flowY = _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(cellY), _mm256_permutevar8x32_ps(stepY, dir)), y);
+            dx = _mm256_blendv_ps(dx, flowX, follow);
+            dy = _mm256_blendv_ps(dy, flowY, follow);
+            dist = _mm256_blendv_ps(dist, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(flowX, flowX), _mm256_mul_ps(flowY, flowY))), follow);
+        }
+        __m256 newX = _mm256_add_ps(x, _mm256_mul_ps(_mm256_div_ps(dx, dist), speed));
+        __m256 newY = _mm256_add_ps(y, _mm256_mul_ps(_mm256_div_ps(dy, dist), speed));
+
+        __m256i wallX = gatherCellsAVX2(solid, chunksY, _mm256_cvttps_epi32(newX), _mm256_cvttps_epi32(y), walk);
+        __m256i moveX = _mm256_andnot_si256(_mm256_cmpgt_epi32(wallX, zero), walk);
+        x = _mm256_blendv_ps(x, newX, _mm256_castsi256_ps(moveX));
+        __m256i wallY = gatherCellsAVX2(solid, chunksY, _mm256_cvttps_epi32(x), _mm256_cvttps_epi32(newY), walk);
+        __m256i moveY = _mm256_andnot_si256(_mm256_cmpgt_epi32(wallY, zero), walk);
+        y = _mm256_blendv_ps(y, newY, _mm256_castsi256_ps(moveY));
+        int changed = _mm256_movemask_ps(_mm256_or_ps(
+            _mm256_cmp_ps(_mm256_floor_ps(x), _mm256_floor_ps(_mm256_loadu_ps(&e.x[i])), _CMP_NEQ_UQ),
+            _mm256_cmp_ps(_mm256_floor_ps(y), _mm256_floor_ps(_mm256_loadu_ps(&e.y[i])), _CMP_NEQ_UQ)));
+        for (; changed; changed &= changed - 1) crossed.push_back(i + __builtin_ctz(changed));
+        _mm256_storeu_ps(&e.x[i], x);
+        _mm256_storeu_ps(&e.y[i], y);
+
+        dx = _mm256_sub_ps(px, x);
+        dy = _mm256_sub_ps(py, y);
+        dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+        contacts += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(dist, range, _CMP_LT_OQ)));
+    }
+    return contacts + updateEnemiesScalar(e, p, i, end, crossed);
+}
+
+#endif // RAYCAST_X86_SIMD
+
+// Update enemies [begin, end) with the AVX2 kernel when simd is set and the
+// CPU has it, otherwise the scalar one
+inline int updateEnemies(EnemyStore& e, const EnemyUpdateParams& p, int begin, int end, bool simd, std::vector<int>& crossed) {
+#ifdef RAYCAST_X86_SIMD
+    if (simd && __builtin_cpu_supports("avx2")) {
+        return updateEnemiesAVX2(e, p, begin, end, crossed);
+    }
+#endif
+    return updateEnemiesScalar(e, p, begin, end, crossed);
+}
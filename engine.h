@@ -0,0 +1,1874 @@
+#pragma once
+
+// Platform-independent engine: world state, simulation and software renderer.
+// Nothing in here touches the Win32 API, so the same code drives the windowed
+// game (main.cpp) and the headless benchmark (headless.cpp).
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <thread>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include "world_map.h"
+#include "raycast.h"
+#include "thread_pool.h"
+#include "transpose.h"
+#include "column_scaler.h"
+#include "palette.h"
+#include "floor_cast.h"
+#include "resolution.h"
+#include "panorama.h"
+#include "enemy_grid.h"
+#include "enemy_store.h"
+#include "flow_field.h"
+#include "profiler.h"
+
+using namespace std;
+
+// Constants for better performance
+const int SCREEN_WIDTH = 800;
+const int SCREEN_HEIGHT = 600;
+const int MAP_WIDTH = 24;   // Size of the map the game generates at startup; see WorldMap for others
+const int MAP_HEIGHT = 24;
+const int CELL_SIZE = 64;  // Size of each map cell
+
+// Wall textures are pre-shaded at load time into LIGHT_LEVELS brightness steps,
+// each in a lit (x side) and a darkened (y side) variant
+const int LIGHT_LEVELS = 16;
+const double SIDE_SHADE = 0.7;          // Brightness of y-side walls relative to x-side walls
+const float LIGHT_FALLOFF_DISTANCE = 16.0f; // Distance at which walls reach the darkest level
+
+// Ceiling and floor colours when textured floor casting is off
+const unsigned int CEILING_COLOR = 0xFF333333;
+const unsigned int FLOOR_COLOR = 0xFF444444;
+
+// Walls further than this are not searched for; rays that find none draw fog.
+// Beyond every wall of the built-in 24x24 level.
+const float MAX_VIEW_DISTANCE = 128.0f;
+const unsigned int FOG_COLOR = 0xFF282828;
+
+// Memory the wall column scaler tables may use before falling back to fixed-point stepping
+const size_t SCALER_CACHE_BUDGET = 8 * 1024 * 1024;
+
+// Reduce raycasting resolution for better performance
+const int RAY_DIVISOR = 4;  // One ray per RAY_DIVISOR screen columns
+
+// Panorama samples per ray for the rotation-only fast path. Ten keeps the
+// samples at under half the ray spacing at the default field of view.
+const int PANORAMA_SAMPLES_PER_RAY = 10;
+
+// Enemies placed on a new level, unless Game::setEnemyCount says otherwise
+const int DEFAULT_ENEMY_COUNT = 5;
+
+// Sprites are drawn for enemies at most this far from the player
+const float SPRITE_RANGE = 20.0f;
+
+// How far the weapon reaches, and the half-angle (radians) of the cone it hits in
+const float WEAPON_RANGE = 8.0f;
+const float WEAPON_CONE = 0.26f;
+const float WEAPON_CONE_COS = std::cos(WEAPON_CONE);
+
+// Side of the square tiles present() transposes and composites in
+const int PRESENT_TILE = 64;
+
+// Frame buffers are cache-line aligned so column strips rendered by different
+// threads only share lines at strip edges
+const int CACHE_LINE_SIZE = 64;
+
+template <typename T>
+T* allocAligned(size_t count) {
+    return static_cast<T*>(::operator new[](count * sizeof(T), std::align_val_t(CACHE_LINE_SIZE)));
+}
+
+template <typename T>
+void freeAligned(T* buffer) {
+    ::operator delete[](buffer, std::align_val_t(CACHE_LINE_SIZE));
+}
+
+// Textures are stored column-major (pre-transposed): texel (x, y) lives at
+// texelIndex(x, y), so a vertical wall or sprite slice is one contiguous run.
+// Anything that fills a texture must write through this.
+inline int texelIndex(int x, int y) {
+    return x * CELL_SIZE + y;
+}
+
+// Add at the top of your file
+const int ANGLE_TABLE_SIZE = 1024;
+float sinTable[ANGLE_TABLE_SIZE];
+float cosTable[ANGLE_TABLE_SIZE];
+
+// Basic 2D vector for map calculations
+struct Vec2 {
+    float x, y;
+    Vec2() : x(0), y(0) {}
+    Vec2(float x, float y) : x(x), y(y) {}
+
+    Vec2 operator+(const Vec2& v) const { return Vec2(x + v.x, y + v.y); }
+    Vec2 operator-(const Vec2& v) const { return Vec2(x - v.x, y - v.y); }
+    Vec2 operator*(float s) const { return Vec2(x * s, y * y); }
+    float length() const { return sqrt(x * x + y * y); }
+    Vec2 normalize() const {
+        float len = length();
+        return len > 0.0001f ? Vec2(x / len, y / len) : Vec2(0, 0);
+    }
+};
+
+// Function declarations for fast trigonometric calculations
+float fastSin(float angle);
+float fastCos(float angle);
+
+// Function implementations
+inline float fastSin(float angle) {
+    int index = int(angle * ANGLE_TABLE_SIZE / (2.0f * M_PI)) % ANGLE_TABLE_SIZE;
+    if (index < 0) index += ANGLE_TABLE_SIZE;
+    return sinTable[index];
+}
+
+inline float fastCos(float angle) {
+    int index = int(angle * ANGLE_TABLE_SIZE / (2.0f * M_PI)) % ANGLE_TABLE_SIZE;
+    if (index < 0) index += ANGLE_TABLE_SIZE;
+    return cosTable[index];
+}
+
+// Player class
+class Player {
+public:
+    Vec2 position;
+    Vec2 direction;
+    Vec2 plane;  // Camera plane
+    float moveSpeed;
+    float rotSpeed;
+    int health;
+    bool hasWeapon;
+
+    Player() : position(5, 5), direction(-1, 0), plane(0, 0.66f),
+              moveSpeed(0.1f), rotSpeed(0.05f), health(100), hasWeapon(true) {}
+
+    void move(float forward, float strafe) {
+        // Move forward/backward
+        Vec2 moveVec = direction * (forward * moveSpeed);
+        position = position + moveVec;
+
+        // Strafe left/right
+        Vec2 strafeVec = Vec2(-direction.y, direction.x) * (strafe * moveSpeed);
+        position = position + strafeVec;
+    }
+
+    void rotate(float angle) {
+        // Rotate direction and plane vectors - precompute sin/cos for performance
+        float cosAngle = fastCos(angle);
+        float sinAngle = fastSin(angle);
+
+        float oldDirX = direction.x;
+        direction.x = direction.x * cosAngle - direction.y * sinAngle;
+        direction.y = oldDirX * sinAngle + direction.y * cosAngle;
+
+        float oldPlaneX = plane.x;
+        plane.x = plane.x * cosAngle - plane.y * sinAngle;
+        plane.y = oldPlaneX * sinAngle + plane.y * cosAngle;
+    }
+};
+
+// Per-frame player input, sampled by whichever front end is driving the game
+// (keyboard/mouse in the window, a script in the headless runner)
+struct InputState {
+    bool forward;
+    bool backward;
+    bool strafeLeft;
+    bool strafeRight;
+    bool fire;
+    float turn;  // Rotation to apply this frame, in radians
+
+    InputState() : forward(false), backward(false), strafeLeft(false), strafeRight(false),
+                   fire(false), turn(0.0f) {}
+};
+
+// An enemy as the renderer sees it: where it stands and who it is
+struct SpriteSource {
+    uint32_t tag; // EnemyStore::tag
+    float x, y;
+};
+
+// State of the game after one simulation tick, as much as rendering needs: the
+// player and the enemies close enough to be drawn, ordered by tag. A renderer on
+// another thread draws from these rather than from the live game.
+struct SimSnapshot {
+    long long tick;
+    double time;          // Seconds on the steady clock when the tick finished
+    Player player;
+    bool gameOver;
+    vector<SpriteSource> sprites;
+
+    SimSnapshot() : tick(0), time(0), gameOver(false) {}
+};
+
+// Solid rectangle of the HUD overlay, already clipped to the screen
+struct HudRect {
+    int x, y, width, height;
+    unsigned int color;
+
+    bool operator==(const HudRect& o) const {
+        return x == o.x && y == o.y && width == o.width && height == o.height && color == o.color;
+    }
+};
+
+// One enemy as projected for a frame. Together with the walls behind it (the
+// zBuffer) this is everything its pixels depend on.
+struct SpriteDraw {
+    int enemy;
+    float depth;              // Camera-space distance
+    int screenX;              // Centre column
+    int width, height;        // Projected size
+    int startX, endX;         // Columns drawn, [startX, endX)
+    int startY, endY;         // Rows drawn, [startY, endY)
+
+    bool operator==(const SpriteDraw& o) const {
+        return enemy == o.enemy && depth == o.depth && screenX == o.screenX &&
+               width == o.width && height == o.height;
+    }
+};
+
+// Everything the wall, floor and ceiling layer of a frame depends on. While it is
+// unchanged, the layer drawn for the last frame is still valid.
+struct SceneKey {
+    Vec2 position, direction, plane;
+    int mapVersion;
+    int viewWidth, viewHeight;
+    bool palettized, columnMajor, texturedFloor, distanceShading;
+    float maxViewDistance;
+
+    bool operator==(const SceneKey& o) const {
+        return position.x == o.position.x && position.y == o.position.y &&
+               direction.x == o.direction.x && direction.y == o.direction.y &&
+               plane.x == o.plane.x && plane.y == o.plane.y && mapVersion == o.mapVersion &&
+               viewWidth == o.viewWidth && viewHeight == o.viewHeight && palettized == o.palettized &&
+               columnMajor == o.columnMajor && texturedFloor == o.texturedFloor &&
+               distanceShading == o.distanceShading && maxViewDistance == o.maxViewDistance;
+    }
+};
+
+// How frames were produced, for judging the frame cache
+struct FrameCacheStats {
+    long long full;     // Whole 3D view drawn
+    long long partial;  // Only columns under changed sprites, or only the HUD, redrawn
+    long long skipped;  // Nothing changed; renderBuffer left as it was
+};
+
+// Game class
+class Game {
+private:
+    Player player;
+    Player camera;       // The player as this frame draws them: a copy, or blended from snapshots
+    bool viewGameOver;   // gameOver as this frame draws it
+    bool snapshotView;   // This frame draws snapshots; the live player and enemies are off limits
+    vector<SpriteSource> spriteSources; // Enemies this frame may draw
+    EnemyStore enemies;  // Live enemies only; a killed one is swapped out
+    EnemyGrid enemyGrid; // Live enemies by position, moved along as they walk
+    vector<int> enemiesCrossed; // Enemies that changed map cell this update
+    int contactUpdates;  // Enemy contacts not yet dealt as damage, fewer than ENEMY_CONTACT_UPDATES
+    bool simdEnemies;    // Update enemies with the AVX2 kernel when the CPU has it
+    int enemyCount;      // Enemies spawnEnemies() places
+    uint32_t seed;       // Seed random was last started from
+    mt19937 random;      // Level and enemy generation; its output sequence is the same on every platform
+    WorldMap worldMap;
+    int mapVersion; // Bumped on every change to worldMap
+    FlowFieldBuilder flowFields;  // Paths to the player; after worldMap, which its worker reads
+    int flowCellX, flowCellY;     // Player cell and map version of the last search request
+    int flowVersion;
+    vector<FlowTarget> flowTargets;
+    bool pathfinding;             // Enemies follow the flow field rather than walking straight at the player
+    OccupancyPyramid occupancy; // Empty-space skipping for the wall caster, kept in step with worldMap while enabled
+    bool emptySpaceSkipping;
+    bool gameOver;
+    unsigned int textureWall[CELL_SIZE * CELL_SIZE];
+    unsigned int textureFloor[CELL_SIZE * CELL_SIZE];
+    unsigned int textureCeiling[CELL_SIZE * CELL_SIZE];
+    unsigned int textureEnemy[CELL_SIZE * CELL_SIZE];
+    vector<unsigned int> wallShades; // Pre-shaded copies of textureWall, see wallShade()
+    vector<unsigned int> enemyShades; // Pre-shaded copies of textureEnemy
+    vector<unsigned int> floorShades, ceilingShades; // Pre-shaded copies of textureFloor/textureCeiling
+    bool distanceShading; // Darken walls and sprites with distance using the pre-shaded levels
+    float maxViewDistance; // Rays give up and draw fog past this distance
+
+    // 8-bit palettized path: textures hold palette indices, lighting goes through
+    // Doom-style colormaps, and the 3D view is drawn into indexedBuffer with the same
+    // layout as the true-colour target, then expanded to ARGB at present time
+    bool palettized;
+    Palette palette;
+    uint8_t wallIndexed[CELL_SIZE * CELL_SIZE];
+    uint8_t enemyIndexed[CELL_SIZE * CELL_SIZE];
+    vector<uint8_t> floorIndexedShades, ceilingIndexedShades; // Lit x-side levels, already through the colormaps
+    vector<uint8_t> colormaps; // [side][level][256] palette index of each shaded colour
+    uint8_t ceilingIndex, floorIndex, fogIndex;
+    uint8_t* indexedBuffer;
+    int indexedColumnStride;
+    uint8_t* indexedTarget; // Same role as sceneTarget, for 8-bit frames
+    unsigned int* renderBuffer; // Where frames are finished: screenBuffer, or the target set by setRenderTarget()
+    unsigned int* screenBuffer; // Pre-allocated buffer for rendering, owned by the game
+    bool targetStale;           // renderBuffer doesn't hold the last frame, so no frame may be presented into it in part
+    float* zBuffer; // Depth buffer for sprites
+    RayHits rayHits; // Per-column rays and wall hits for the current frame
+    RayHits weaponRay; // The shot traced by shootWeapon()
+    int rayPacketWidth; // Rays traced together by the wall caster (1 = scalar)
+    unique_ptr<ThreadPool> threadPool; // Workers for the column-parallel wall pass
+
+    // Where the 3D view is drawn. Row-major mode draws straight into renderBuffer;
+    // column-major mode draws into sceneBuffer and transposes it at present time.
+    bool columnMajorTarget;
+    unsigned int* sceneBuffer; // Column-major 3D view, sceneColumnStride pixels per column
+    int sceneColumnStride;
+    unsigned int* sceneTarget; // Buffer the current frame's 3D view goes to
+    int targetStrideX, targetStrideY; // Pixel (x, y) is sceneTarget[x * targetStrideX + y * targetStrideY]
+    vector<HudRect> hudRects; // HUD overlay for the current frame, composited at present
+    ColumnScalerCache columnScalers; // Texel row per screen row, per wall lineHeight
+
+    // Textured floor and ceiling casting
+    bool texturedFloor;
+    vector<float> rowDistance; // Distance to the floor/ceiling seen by each screen row
+    FloorRows floorRows; // Per-row texture start and step for the current frame
+
+    // Output resolution, fixed for the lifetime of the game
+    int screenWidth;
+    int screenHeight;
+
+    // Resolution the 3D view is rendered at, upscaled to the output by present().
+    // The same as the output unless dynamic resolution has scaled it down.
+    int viewWidth;
+    int viewHeight;
+    int rayWidth;
+    float rayScale;
+    vector<int> sourceColumn, sourceRow; // View column/row each output column/row is upscaled from
+    ResolutionController resolution;
+    double sceneTime; // Milliseconds spent in the last renderScene
+
+    // Rotation-only fast path, see panorama.h. Used while the camera position is the
+    // same as in the last renderScene.
+    bool panoramaEnabled;
+    Panorama panorama;
+    bool castValid; // lastCastPosition holds the position of the last renderScene
+    Vec2 lastCastPosition;
+
+    // Static-frame caching, see render(). Needs the 3D view in a buffer of its own
+    // (column-major or palettized): a row-major true-colour view has the HUD drawn into it.
+    bool frameCaching;
+    bool sceneValid; // The view buffer and rayHits hold the layer described by sceneKey
+    SceneKey sceneKey;
+    vector<SpriteDraw> spriteDraws, lastSpriteDraws;
+    vector<HudRect> lastHudRects;
+    vector<uint8_t> dirtyColumns; // View columns to redraw this frame
+    vector<uint8_t> dirtyTiles;   // Output tiles to present this frame
+    FrameCacheStats frameStats;
+
+public:
+    // Levels are generated from levelSeed; the same seed gives the same levels and enemies
+    Game(int width = SCREEN_WIDTH, int height = SCREEN_HEIGHT, uint32_t levelSeed = uint32_t(time(nullptr)))
+        : viewGameOver(false), snapshotView(false), contactUpdates(0), simdEnemies(true), enemyCount(DEFAULT_ENEMY_COUNT), seed(levelSeed), random(levelSeed), mapVersion(0), flowCellX(-1), flowCellY(-1), flowVersion(-1), pathfinding(true),
+          emptySpaceSkipping(false), gameOver(false), distanceShading(false), maxViewDistance(MAX_VIEW_DISTANCE), palettized(false),
+          ceilingIndex(0), floorIndex(0), fogIndex(0),
+          indexedBuffer(NULL), indexedColumnStride(0), indexedTarget(NULL), renderBuffer(NULL), screenBuffer(NULL), targetStale(false), zBuffer(NULL),
+          rayPacketWidth(detectRayPacketWidth()), columnMajorTarget(false), sceneBuffer(NULL), sceneColumnStride(0),
+          sceneTarget(NULL), targetStrideX(1), targetStrideY(width), texturedFloor(true),
+          screenWidth(width), screenHeight(height), viewWidth(0), viewHeight(0),
+          rayWidth(0), rayScale(1.0f), sceneTime(0), panoramaEnabled(true), castValid(false), frameCaching(true), sceneValid(false) {
+        // Initialize buffers for rendering optimization
+        screenBuffer = allocAligned<unsigned int>(screenWidth * screenHeight);
+        renderBuffer = screenBuffer;
+        zBuffer = allocAligned<float>(screenWidth);
+        dirtyColumns.resize(screenWidth);
+        dirtyTiles.resize(((screenWidth + PRESENT_TILE - 1) / PRESENT_TILE) * ((screenHeight + PRESENT_TILE - 1) / PRESENT_TILE));
+        frameStats.full = frameStats.partial = frameStats.skipped = 0;
+        columnScalers.init(CELL_SIZE, screenHeight * 10, SCALER_CACHE_BUDGET);
+        floorRows.textureSize = CELL_SIZE;
+        setViewSize(screenWidth, screenHeight);
+
+        // Generate the starting level
+        generateMap(MAP_WIDTH, MAP_HEIGHT);
+
+        // Initialize textures with simple patterns
+        createTextures();
+
+        // Initialize trigonometric tables
+        initTrigTables();
+
+        // One render thread per core by default
+        setThreadCount(int(thread::hardware_concurrency()));
+
+        // Column-major 3D view by default; it produces the same frame with far less memory traffic
+        setColumnMajorTarget(true);
+
+        // Search enemy paths in the background
+        flowFields.setThreaded(true);
+    }
+
+    ~Game() {
+        if (screenBuffer) freeAligned(screenBuffer);
+        if (zBuffer) freeAligned(zBuffer);
+        if (sceneBuffer) freeAligned(sceneBuffer);
+        if (indexedBuffer) freeAligned(indexedBuffer);
+    }
+
+    // Random integer in [0, n). Scales the generator's 32 bits itself rather than
+    // going through a standard distribution, whose results differ between standard
+    // libraries, so a seed gives the same level everywhere.
+    int randomBelow(int n) {
+        return int((uint64_t(random()) * uint64_t(n)) >> 32);
+    }
+
+    // Restart level generation from seed. The next generateMap(), loadMap() or
+    // setEnemyCount() then builds the same level as any game given this seed.
+    void setSeed(uint32_t levelSeed) {
+        seed = levelSeed;
+        random.seed(levelSeed);
+    }
+
+    uint32_t getSeed() const { return seed; }
+
+    // FNV-1a over everything the simulation carries from one update to the next:
+    // the player, contacts not yet dealt as damage, every enemy in store order,
+    // the map version and gameOver. Two
+    // runs that agree on it after every update have simulated the same game.
+    uint64_t stateChecksum() const {
+        uint64_t hash = 1469598103934665603ull;
+        auto mix = [&](const void* data, size_t bytes) {
+            const unsigned char* p = (const unsigned char*)data;
+            for (size_t i = 0; i < bytes; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+        };
+        mix(&player.position, sizeof(Vec2));
+        mix(&player.direction, sizeof(Vec2));
+        mix(&player.plane, sizeof(Vec2));
+        mix(&player.health, sizeof(player.health));
+        mix(&contactUpdates, sizeof(contactUpdates));
+        mix(&gameOver, sizeof(gameOver));
+        mix(&mapVersion, sizeof(mapVersion));
+        int count = enemies.size();
+        mix(&count, sizeof(count));
+        mix(enemies.x.data(), count * sizeof(float));
+        mix(enemies.y.data(), count * sizeof(float));
+        mix(enemies.health.data(), count * sizeof(int));
+        mix(enemies.tag.data(), count * sizeof(uint32_t));
+        return hash;
+    }
+
+    // Replace the level with a random width x height map: border walls, interior walls
+    // at the density of the built-in 24x24 map, and a few enemies. The player starts at
+    // the usual spawn point. Returns false if the map would be too large.
+    bool generateMap(int width, int height) {
+        if (width < 8 || height < 8) return false;
+        flowFields.finish(); // A threaded search may be reading the map
+        if (!worldMap.create(width, height)) return false;
+        player.position = Vec2(5, 5);
+        worldMap.setSpawn(player.position.x, player.position.y);
+
+        // Border walls (1 = wall, 0 = empty)
+        for (int x = 0; x < width; x++) {
+            worldMap.set(x, 0, 1);
+            worldMap.set(x, height - 1, 1);
+        }
+        for (int y = 0; y < height; y++) {
+            worldMap.set(0, y, 1);
+            worldMap.set(width - 1, y, 1);
+        }
+
+        // Add some interior walls to make a maze-like structure
+        long long walls = 50LL * (width - 2) * (height - 2) / ((MAP_WIDTH - 2) * (MAP_HEIGHT - 2));
+        for (long long i = 0; i < walls; i++) {
+            int x = randomBelow(width - 2) + 1;
+            int y = randomBelow(height - 2) + 1;
+            // Don't place walls near the player spawn point
+            if (abs(x - player.position.x) > 3 || abs(y - player.position.y) > 3) {
+                worldMap.set(x, y, 1);
+            }
+        }
+
+        spawnEnemies();
+        mapReplaced();
+        return true;
+    }
+
+    // Map a level from a map file (see world_map.h). Startup cost doesn't depend on the
+    // map size: chunks are paged in as rays, enemies and the player reach them. The
+    // player starts at the file's spawn point. Returns false, keeping the current
+    // level, if the file can't be mapped.
+    bool loadMap(const char* path) {
+        flowFields.finish();
+        if (!worldMap.load(path)) return false;
+        player.position = Vec2(worldMap.getSpawnX(), worldMap.getSpawnY());
+        spawnEnemies();
+        mapReplaced();
+        return true;
+    }
+
+    // Write the current level, including runtime edits, as a map file
+    bool saveMap(const char* path) const { return worldMap.save(path); }
+
+    // Add some enemies, away from the player, and file them in the grid
+    void spawnEnemies() {
+        enemies.clear();
+        for (int i = 0; i < enemyCount; i++) {
+            float x = randomBelow(worldMap.getWidth() - 4) + 2;
+            float y = randomBelow(worldMap.getHeight() - 4) + 2;
+            // Don't spawn enemies too close to the player
+            if (abs(x - player.position.x) > 5 || abs(y - player.position.y) > 5) {
+                enemies.add(x, y);
+            }
+        }
+        enemyGrid.reset(worldMap.getWidth(), worldMap.getHeight(), enemies.size());
+        for (int i = 0; i < enemies.size(); i++) {
+            enemyGrid.insert(i, enemies.x[i], enemies.y[i]);
+        }
+        sceneValid = false; // The buckets marked for sprites went with the old grid
+    }
+
+    // Everything derived from the map is stale after a new level
+    void mapReplaced() {
+        mapVersion++;
+        flowFields.reset();
+        if (emptySpaceSkipping) occupancy.build(worldMap);
+    }
+
+    void createTextures() {
+        // Simple checkerboard pattern for walls
+        for (int x = 0; x < CELL_SIZE; x++) {
+            for (int y = 0; y < CELL_SIZE; y++) {
+                int pattern = (x / 8 + y / 8) % 2;
+                textureWall[texelIndex(x, y)] = pattern ? 0xFF0000FF : 0xFF888888;
+            }
+        }
+
+        // Floor texture
+        for (int x = 0; x < CELL_SIZE; x++) {
+            for (int y = 0; y < CELL_SIZE; y++) {
+                int pattern = (x / 16 + y / 16) % 2;
+                textureFloor[texelIndex(x, y)] = pattern ? 0xFF005500 : 0xFF003300;
+            }
+        }
+
+        // Ceiling texture: grey panels with darker seams
+        for (int x = 0; x < CELL_SIZE; x++) {
+            for (int y = 0; y < CELL_SIZE; y++) {
+                bool seam = x % 32 < 2 || y % 32 < 2;
+                textureCeiling[texelIndex(x, y)] = seam ? 0xFF222222 : 0xFF333333;
+            }
+        }
+
+        // Enemy texture (simple red blob)
+        for (int x = 0; x < CELL_SIZE; x++) {
+            for (int y = 0; y < CELL_SIZE; y++) {
+                float dx = x - CELL_SIZE/2;
+                float dy = y - CELL_SIZE/2;
+                float dist = sqrt(dx*dx + dy*dy);
+                if (dist < CELL_SIZE/3) {
+                    textureEnemy[texelIndex(x, y)] = 0xFFFF0000;
+                } else if (dist < CELL_SIZE/2) {
+                    textureEnemy[texelIndex(x, y)] = 0x88FF0000;
+                } else {
+                    textureEnemy[texelIndex(x, y)] = 0;
+                }
+            }
+        }
+
+        // Shaded variants for side and distance lighting
+        bakeShades(textureWall, wallShades);
+        bakeShades(textureEnemy, enemyShades);
+        bakeShades(textureFloor, floorShades);
+        bakeShades(textureCeiling, ceilingShades);
+
+        buildPalette();
+    }
+
+    // Gather every colour the renderer can produce into the palette, then index the
+    // textures and build a colormap per side and light level. The unshaded texture
+    // colours go first so they are the ones kept exactly if the palette overflows.
+    void buildPalette() {
+        const int texels = CELL_SIZE * CELL_SIZE;
+        vector<unsigned int> colors;
+        colors.push_back(CEILING_COLOR);
+        colors.push_back(FLOOR_COLOR);
+        colors.push_back(FOG_COLOR);
+        colors.insert(colors.end(), textureWall, textureWall + texels);
+        colors.insert(colors.end(), textureEnemy, textureEnemy + texels);
+        colors.insert(colors.end(), textureFloor, textureFloor + texels);
+        colors.insert(colors.end(), textureCeiling, textureCeiling + texels);
+        colors.insert(colors.end(), wallShades.begin(), wallShades.end());
+        colors.insert(colors.end(), enemyShades.begin(), enemyShades.end());
+        // Floors and ceilings only use the x-side levels
+        colors.insert(colors.end(), floorShades.begin(), floorShades.begin() + LIGHT_LEVELS * texels);
+        colors.insert(colors.end(), ceilingShades.begin(), ceilingShades.begin() + LIGHT_LEVELS * texels);
+        palette.build(colors);
+
+        for (int i = 0; i < texels; i++) {
+            wallIndexed[i] = palette.find(textureWall[i]);
+            enemyIndexed[i] = palette.find(textureEnemy[i]);
+        }
+        ceilingIndex = palette.find(CEILING_COLOR);
+        floorIndex = palette.find(FLOOR_COLOR);
+        fogIndex = palette.find(FOG_COLOR);
+
+        colormaps.assign(2 * LIGHT_LEVELS * 256, PALETTE_TRANSPARENT);
+        for (int side = 0; side < 2; side++) {
+            for (int level = 0; level < LIGHT_LEVELS; level++) {
+                double factor = shadeFactor(side, level);
+                uint8_t* colormap = &colormaps[(side * LIGHT_LEVELS + level) * 256];
+                for (int i = 1; i < palette.size(); i++) {
+                    colormap[i] = palette.find(shadeTexel(palette.color(i), factor));
+                }
+            }
+        }
+
+        indexShades(textureFloor, floorIndexedShades);
+        indexShades(textureCeiling, ceilingIndexedShades);
+    }
+
+    // 8-bit copy of a texture at every x-side light level, for the floor caster.
+    // Padded because the caster gathers 8-bit texels as 32-bit words.
+    void indexShades(const unsigned int* texture, vector<uint8_t>& shades) const {
+        const int texels = CELL_SIZE * CELL_SIZE;
+        shades.assign(LIGHT_LEVELS * texels + 3, PALETTE_TRANSPARENT);
+        for (int level = 0; level < LIGHT_LEVELS; level++) {
+            const uint8_t* colormap = &colormaps[level * 256];
+            for (int i = 0; i < texels; i++) {
+                shades[level * texels + i] = colormap[palette.find(texture[i])];
+            }
+        }
+    }
+
+    // Brightness of a light level: 1.0 at level 0, falling linearly to 0.25 at the darkest
+    static double lightFactor(int level) {
+        return 1.0 - 0.75 * level / (LIGHT_LEVELS - 1);
+    }
+
+    // Combined brightness of a wall side (0 = x side, 1 = darker y side) at a light level
+    static double shadeFactor(int side, int level) {
+        return lightFactor(level) * (side == 1 ? SIDE_SHADE : 1.0);
+    }
+
+    // Darken one texel, keeping its alpha so transparent sprite texels stay transparent
+    static unsigned int shadeTexel(unsigned int texel, double factor) {
+        if (factor == 1.0) return texel;
+        unsigned int r = (texel >> 16) & 0xFF;
+        unsigned int g = (texel >> 8) & 0xFF;
+        unsigned int b = texel & 0xFF;
+        r = r * factor;
+        g = g * factor;
+        b = b * factor;
+        return (texel & 0xFF000000) | (r << 16) | (g << 8) | b;
+    }
+
+    // Bake every side/light-level variant of a texture, so the draw loops only fetch texels
+    static void bakeShades(const unsigned int* texture, vector<unsigned int>& shades) {
+        const int texels = CELL_SIZE * CELL_SIZE;
+        shades.resize(2 * LIGHT_LEVELS * texels);
+        for (int side = 0; side < 2; side++) {
+            for (int level = 0; level < LIGHT_LEVELS; level++) {
+                double factor = shadeFactor(side, level);
+                unsigned int* shade = &shades[(side * LIGHT_LEVELS + level) * texels];
+                for (int i = 0; i < texels; i++) {
+                    shade[i] = shadeTexel(texture[i], factor);
+                }
+            }
+        }
+    }
+
+    // Pre-shaded wall texture for a wall side and light level
+    const unsigned int* wallShade(int side, int level) const {
+        return &wallShades[(side * LIGHT_LEVELS + level) * CELL_SIZE * CELL_SIZE];
+    }
+
+    // Texel column texX of a texture, lit for a side and light level, in the pixel format
+    // being drawn. True colour points into the pre-shaded copy; 8-bit runs the column's
+    // CELL_SIZE texels through the colormap once, so per-pixel loops never do lighting.
+    const unsigned int* litColumn(const vector<unsigned int>& shades, const uint8_t*,
+                                  int side, int level, int texX, unsigned int*) const {
+        return &shades[(side * LIGHT_LEVELS + level) * CELL_SIZE * CELL_SIZE + texelIndex(texX, 0)];
+    }
+
+    const uint8_t* litColumn(const vector<unsigned int>&, const uint8_t* indexed,
+                             int side, int level, int texX, uint8_t* lit) const {
+        const uint8_t* colormap = &colormaps[(side * LIGHT_LEVELS + level) * 256];
+        const uint8_t* texels = indexed + texelIndex(texX, 0);
+        for (int i = 0; i < CELL_SIZE; i++) {
+            lit[i] = colormap[texels[i]];
+        }
+        return lit;
+    }
+
+    // Sprite transparency: zero alpha in true colour, the reserved index in 8-bit
+    static bool isOpaque(unsigned int texel) { return (texel & 0xFF000000) != 0; }
+    static bool isOpaque(uint8_t texel) { return texel != PALETTE_TRANSPARENT; }
+
+    // Flat ceiling and floor colours in each pixel format
+    void flatColors(unsigned int& ceiling, unsigned int& floor, unsigned int& fog) const {
+        ceiling = CEILING_COLOR;
+        floor = FLOOR_COLOR;
+        fog = FOG_COLOR;
+    }
+
+    void flatColors(uint8_t& ceiling, uint8_t& floor, uint8_t& fog) const {
+        ceiling = ceilingIndex;
+        floor = floorIndex;
+        fog = fogIndex;
+    }
+
+    // Floor and ceiling textures, all x-side light levels, in each pixel format
+    void surfaceTextures(const unsigned int*& ceiling, const unsigned int*& floor) const {
+        ceiling = ceilingShades.data();
+        floor = floorShades.data();
+    }
+
+    void surfaceTextures(const uint8_t*& ceiling, const uint8_t*& floor) const {
+        ceiling = ceilingIndexedShades.data();
+        floor = floorIndexedShades.data();
+    }
+
+    // Light level for a wall at the given distance (0 when distance shading is off)
+    int lightLevel(float distance) const {
+        if (!distanceShading) return 0;
+        int level = int(distance * LIGHT_LEVELS / LIGHT_FALLOFF_DISTANCE);
+        return min(level, LIGHT_LEVELS - 1);
+    }
+
+    int getScreenWidth() const { return screenWidth; }
+    int getScreenHeight() const { return screenHeight; }
+
+    // Render the 3D view at width x height (at most the output size) and upscale it to
+    // the output at present time. One ray is cast per RAY_DIVISOR view columns.
+    void setViewSize(int width, int height) {
+        width = max(RAY_DIVISOR, min(width, screenWidth));
+        height = max(2, min(height, screenHeight));
+        if (width == viewWidth && height == viewHeight) return;
+
+        if (height != viewHeight) {
+            // Row y sees the floor (or ceiling) where a wall would be 2 * |y - horizon| pixels
+            // tall. The horizon row itself is always covered by a wall.
+            rowDistance.resize(height);
+            for (int y = 0; y < height; y++) {
+                int p = abs(y - height / 2);
+                rowDistance[y] = 0.5f * height / max(p, 1);
+            }
+            floorRows.resize(height);
+
+            // Slice row counts are clipped to the view height, so cached scalers are stale
+            columnScalers.clear();
+        }
+
+        viewWidth = width;
+        viewHeight = height;
+        rayWidth = viewWidth / RAY_DIVISOR;
+        rayScale = static_cast<float>(viewWidth) / rayWidth;
+        rayHits.resize(rayWidth);
+        panorama.resize(rayWidth * PANORAMA_SAMPLES_PER_RAY);
+
+        sourceColumn.resize(screenWidth);
+        for (int x = 0; x < screenWidth; x++) {
+            sourceColumn[x] = x * viewWidth / screenWidth;
+        }
+        sourceRow.resize(screenHeight);
+        for (int y = 0; y < screenHeight; y++) {
+            sourceRow[y] = y * viewHeight / screenHeight;
+        }
+    }
+
+    int getViewWidth() const { return viewWidth; }
+    int getViewHeight() const { return viewHeight; }
+
+    // Scale the view every frame to keep renderScene within budgetMs milliseconds, in
+    // both dimensions or (scaleHeight false) only in ray count. 0 turns it off.
+    void setDynamicResolution(double budgetMs, bool scaleHeight = true) {
+        resolution.setBudget(budgetMs, scaleHeight);
+        setViewSize(screenWidth, screenHeight);
+    }
+
+    const ResolutionController& getResolutionController() const { return resolution; }
+
+    // Cost of the last frame's 3D view (walls, floors, sprites) in milliseconds
+    double getSceneTime() const { return sceneTime; }
+
+    // Take the walls of rotation-only frames from a panorama traced around the player
+    // instead of casting every ray
+    void setPanorama(bool enabled) { panoramaEnabled = enabled; }
+
+    bool isPanorama() const { return panoramaEnabled; }
+
+    PanoramaStats getPanoramaStats() const { return panorama.stats(); }
+
+    // Reuse the last frame's wall layer while nothing it depends on has changed
+    void setFrameCaching(bool enabled) {
+        frameCaching = enabled;
+        sceneValid = false;
+    }
+
+    bool isFrameCaching() const { return frameCaching; }
+
+    FrameCacheStats getFrameCacheStats() const { return frameStats; }
+
+    // Finished frame, row-major ARGB, screenWidth * screenHeight pixels
+    const unsigned int* getRenderBuffer() const { return renderBuffer; }
+
+    // Finish frames in target (screenWidth * screenHeight pixels, owned by the
+    // caller) instead of the game's own buffer; NULL goes back to the game's.
+    // Lets a frame pipeline (frame_pipeline.h) render into one buffer while it
+    // presents another. A new target doesn't hold the last frame, so the next
+    // frame drawn into it is presented whole even if only sprites moved.
+    void setRenderTarget(unsigned int* target) {
+        if (!target) target = screenBuffer;
+        if (target == renderBuffer) return;
+        renderBuffer = target;
+        targetStale = true;
+    }
+
+    const Player& getPlayer() const { return player; }
+
+    int getMapWidth() const { return worldMap.getWidth(); }
+    int getMapHeight() const { return worldMap.getHeight(); }
+
+    int getMapCell(int x, int y) const { return worldMap.at(x, y); }
+
+    // Respawn the level's enemies, this many attempts' worth (those that would land
+    // next to the player are skipped). Sprite gathering and the weapon find enemies
+    // through the grid and the AI is one SIMD pass, so a level can hold 100k or more.
+    void setEnemyCount(int count) {
+        enemyCount = max(0, count);
+        spawnEnemies();
+    }
+
+    int getEnemyCount() const { return enemies.size(); }
+
+    // Let enemies find their way around walls through the shared flow field
+    // (flow_field.h), or walk straight at the player as they used to
+    void setPathfinding(bool enabled) { pathfinding = enabled; }
+
+    bool getPathfinding() const { return pathfinding; }
+
+    // Update enemies with the AVX2 kernel on CPUs that have it (the default), or
+    // always with the scalar one. Both move enemies identically.
+    void setSimdEnemyUpdate(bool enabled) { simdEnemies = enabled; }
+
+    bool getSimdEnemyUpdate() const { return simdEnemies; }
+
+    // Search the flow field on a worker thread (the default) or inside update().
+    // Inline searches make runs repeatable: enemies then always follow a field
+    // searched the same update the player entered their cell.
+    void setPathfindingThreaded(bool enabled) { flowFields.setThreaded(enabled); }
+
+    // Change one map cell (0 = empty, 1 = wall). All runtime map edits go through here
+    // so cached frames know the walls changed.
+    void setMapCell(int x, int y, int value) {
+        if (!worldMap.inside(x, y) || worldMap.at(x, y) == value) return;
+        flowFields.finish();
+        worldMap.set(x, y, uint8_t(value));
+        if (emptySpaceSkipping) occupancy.set(x, y, value > 0);
+        mapVersion++;
+    }
+
+    bool isGameOver() const { return gameOver; }
+
+    // Choose the wall casting kernel: 1 for scalar, or 4/8/16 rays per SSE/AVX2/AVX-512
+    // packet. Falls back to the widest kernel the CPU supports; returns the width in use.
+    int setRayPacketWidth(int width) {
+        rayPacketWidth = selectRayPacketWidth(width);
+        return rayPacketWidth;
+    }
+
+    int getRayPacketWidth() const { return rayPacketWidth; }
+
+    // Number of threads (including the caller) that share the wall pass
+    void setThreadCount(int threads) {
+        threads = max(threads, 1);
+        if (threadPool && threadPool->size() == threads) return;
+        threadPool.reset(new ThreadPool(threads));
+    }
+
+    int getThreadCount() const { return threadPool->size(); }
+
+    // Let wall rays leap across empty blocks of the occupancy pyramid instead of
+    // stepping every cell. Pays off on large open maps; rays are then cast one at a
+    // time rather than in packets. Enabling builds the pyramid, which reads the whole map.
+    void setEmptySpaceSkipping(bool enabled) {
+        if (enabled && !emptySpaceSkipping) occupancy.build(worldMap);
+        emptySpaceSkipping = enabled;
+    }
+
+    bool isEmptySpaceSkipping() const { return emptySpaceSkipping; }
+
+    // Draw the 3D view column-major and transpose it at present time, instead of
+    // scattering every column write across screenHeight rows of renderBuffer
+    void setColumnMajorTarget(bool enabled) {
+        columnMajorTarget = enabled;
+        if (enabled && !sceneBuffer) {
+            // Round columns up to whole cache lines so each one starts on a line boundary
+            int pixelsPerLine = CACHE_LINE_SIZE / sizeof(unsigned int);
+            sceneColumnStride = (screenHeight + pixelsPerLine - 1) / pixelsPerLine * pixelsPerLine;
+            sceneBuffer = allocAligned<unsigned int>(sceneColumnStride * screenWidth);
+        }
+    }
+
+    bool isColumnMajorTarget() const { return columnMajorTarget; }
+
+    // Rebuild the wall scaler cache with a new memory budget
+    void setScalerCacheBudget(size_t bytes) {
+        columnScalers.init(CELL_SIZE, screenHeight * 10, bytes);
+    }
+
+    ScalerCacheStats getScalerCacheStats() const { return columnScalers.stats(); }
+
+    void setDistanceShading(bool enabled) { distanceShading = enabled; }
+
+    // How far rays search for a wall, in cells. Past it the view shows fog, and a
+    // ray's cost is bounded however open the map is. Clamped to [1, 1e6].
+    void setMaxViewDistance(float distance) { maxViewDistance = max(1.0f, min(distance, 1e6f)); }
+
+    float getMaxViewDistance() const { return maxViewDistance; }
+
+    // Draw the 3D view with 8-bit palette indices instead of ARGB. A quarter of the
+    // framebuffer traffic; the frame is the same as long as the palette holds every
+    // shaded colour, which it does for the built-in textures.
+    void setPalettized(bool enabled) {
+        palettized = enabled;
+        if (enabled && !indexedBuffer) {
+            // Room for either layout, with columns rounded up to whole cache lines
+            indexedColumnStride = (screenHeight + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+            indexedBuffer = allocAligned<uint8_t>(max(indexedColumnStride * screenWidth, screenWidth * screenHeight));
+        }
+    }
+
+    bool isPalettized() const { return palettized; }
+
+    // Cast textured floors and ceilings, or fill them with flat colours
+    void setTexturedFloor(bool enabled) { texturedFloor = enabled; }
+
+    bool isTexturedFloor() const { return texturedFloor; }
+
+    // Place the camera directly, bypassing input and collision.
+    // Used by the headless runner to render fixed viewpoints.
+    void setCamera(const Vec2& position, const Vec2& direction, const Vec2& plane) {
+        player.position = position;
+        player.direction = direction;
+        player.plane = plane;
+    }
+
+    void update(const InputState& input) {
+        PROFILE_SCOPE("update");
+        if (gameOver) return;
+
+        // Handle keyboard input for movement
+        if (input.forward) {
+            movePlayer(1.0f, 0.0f);
+        }
+        if (input.backward) {
+            movePlayer(-1.0f, 0.0f);
+        }
+        if (input.strafeLeft) {
+            movePlayer(0.0f, -1.0f);
+        }
+        if (input.strafeRight) {
+            movePlayer(0.0f, 1.0f);
+        }
+
+        // Handle mouse for rotation
+        if (input.turn != 0.0f) {
+            player.rotate(input.turn);
+        }
+
+        // Search new paths once the player enters another cell or the walls change
+        int cellX = int(player.position.x), cellY = int(player.position.y);
+        if (cellX != flowCellX || cellY != flowCellY || mapVersion != flowVersion) {
+            flowCellX = cellX;
+            flowCellY = cellY;
+            flowVersion = mapVersion;
+            flowTargets.assign(1, FlowTarget{cellX, cellY});
+            flowFields.request(worldMap, flowTargets, mapVersion);
+        }
+
+        // Walk every enemy toward the player; each one touching them deals a point of damage.
+        // Only enemies that entered another map cell can have left their grid bucket.
+        EnemyUpdateParams params;
+        params.solid = worldMap.solidBits();
+        params.mapChunksY = worldMap.getChunksY();
+        params.playerX = player.position.x;
+        params.playerY = player.position.y;
+        params.flow = pathfinding ? flowFields.current() : NULL;
+        {
+            PROFILE_SCOPE("update enemies");
+            enemiesCrossed.clear();
+            contactUpdates += updateEnemies(enemies, params, 0, enemies.size(), simdEnemies, enemiesCrossed);
+            player.health -= contactUpdates / ENEMY_CONTACT_UPDATES;
+            contactUpdates %= ENEMY_CONTACT_UPDATES;
+            for (int i : enemiesCrossed) {
+                enemyGrid.move(i, enemies.x[i], enemies.y[i]);
+            }
+        }
+
+        // Check for player shooting
+        if (input.fire && player.hasWeapon) {
+            shootWeapon();
+        }
+
+        // Check game over condition
+        if (player.health <= 0) {
+            gameOver = true;
+        }
+    }
+
+    // FIX 1: Correct the strafe movement direction in movePlayer method
+    void movePlayer(float forward, float strafe) {
+        Vec2 newPos = player.position;
+
+        // Calculate new position
+        if (forward != 0) {
+            newPos.x += player.direction.x * forward * player.moveSpeed;
+            newPos.y += player.direction.y * forward * player.moveSpeed;
+        }
+
+        if (strafe != 0) {
+            // Fix the A/D controls by reversing the sign on strafe
+            newPos.x += player.direction.y * strafe * player.moveSpeed;  // Changed sign
+            newPos.y += -player.direction.x * strafe * player.moveSpeed; // Changed sign
+        }
+
+        // Add a small buffer to collision detection to keep the player slightly away from walls.
+        // The buffer has to follow the direction of travel on each axis, otherwise walking
+        // backwards or strafing lets the player slip into (and through) the border walls.
+        float wallBuffer = 0.1f;
+        float bufferX = newPos.x > player.position.x ? wallBuffer : -wallBuffer;
+        float bufferY = newPos.y > player.position.y ? wallBuffer : -wallBuffer;
+
+        if (!worldMap.blocked(int(newPos.x + bufferX), int(player.position.y))) {
+            player.position.x = newPos.x;
+        }
+        if (!worldMap.blocked(int(player.position.x), int(newPos.y + bufferY))) {
+            player.position.y = newPos.y;
+        }
+    }
+
+    // Hitscan: trace the shot along the view direction with the wall caster's DDA,
+    // then look only at enemies in the grid buckets along the ray up to the wall.
+    // The nearest enemy inside the cone (lowest index on a tie) takes the hit.
+    void shootWeapon() {
+        PROFILE_SCOPE("shoot");
+        RayCastParams params = { player.position.x, player.position.y, worldMap.solidBits(), worldMap.getWidth(),
+                                 worldMap.getHeight(), worldMap.getChunksY(), NULL, WEAPON_RANGE };
+        weaponRay.resize(1);
+        weaponRay.rayDirX[0] = player.direction.x;
+        weaponRay.rayDirY[0] = player.direction.y;
+        castRays(params, weaponRay, 0, 1, 1);
+        float wallDist = weaponRay.perpWallDist[0]; // WEAPON_RANGE if no wall is in reach
+
+        float endX = player.position.x + player.direction.x * wallDist;
+        float endY = player.position.y + player.direction.y * wallDist;
+        int target = -1;
+        float targetDist = 0;
+        enemyGrid.forEachAlongSegment(player.position.x, player.position.y, endX, endY, [&](int i) {
+            float dx = enemies.x[i] - player.position.x;
+            float dy = enemies.y[i] - player.position.y;
+            float dist = dx * dx + dy * dy;
+
+            // In the cone when the cosine of the angle to the enemy beats the threshold:
+            // dot > cos * length, squared to skip the square root. The direction is unit length.
+            float dot = player.direction.x * dx + player.direction.y * dy;
+            if (dot <= 0 || dot * dot <= WEAPON_CONE_COS * WEAPON_CONE_COS * dist) return;
+            if (dist >= WEAPON_RANGE * WEAPON_RANGE || dot >= wallDist) return; // Out of reach or behind the wall
+            if (target < 0 || dist < targetDist || (dist == targetDist && i < target)) {
+                target = i;
+                targetDist = dist;
+            }
+        });
+
+        if (target < 0) return;
+        enemies.health[target] -= 10;
+        if (enemies.health[target] <= 0) {
+            killEnemy(target);
+        }
+    }
+
+    // Take enemy i out of the store and the grid. The last enemy fills its slot,
+    // so its grid entry follows it to index i.
+    void killEnemy(int i) {
+        enemyGrid.remove(i);
+        int moved = enemies.removeAt(i);
+        if (moved >= 0) {
+            enemyGrid.remove(moved);
+            enemyGrid.insert(i, enemies.x[i], enemies.y[i]);
+        }
+    }
+
+    // Pick the buffer and pixel layout for this frame's 3D view
+    void selectSceneTarget() {
+        if (columnMajorTarget) {
+            sceneTarget = sceneBuffer;
+            targetStrideX = palettized ? indexedColumnStride : sceneColumnStride;
+            targetStrideY = 1;
+        } else {
+            sceneTarget = renderBuffer;
+            targetStrideX = 1;
+            targetStrideY = screenWidth;
+        }
+        indexedTarget = indexedBuffer;
+    }
+
+    // FIX 2: Add minimum distance check in renderScene method
+    // Draw the whole 3D view: walls, floor and ceiling, then the sprites of the
+    // enemies the rays could see
+    void renderScene() {
+        PROFILE_SCOPE("scene");
+        selectSceneTarget();
+
+        // Clear Z-buffer
+        for (int x = 0; x < viewWidth; x++) {
+            zBuffer[x] = std::numeric_limits<float>::max();
+        }
+
+        // Ray direction for every column, shared by all casting kernels
+        for (int x = 0; x < rayWidth; x++) {
+            float cameraX = 2.0f * x / rayWidth - 1.0f; // X-coordinate in camera space
+            rayHits.rayDirX[x] = camera.direction.x + camera.plane.x * cameraX;
+            rayHits.rayDirY[x] = camera.direction.y + camera.plane.y * cameraX;
+        }
+
+        // World-space start and step of every floor/ceiling row, in texels
+        if (texturedFloor) {
+            float rayDir0X = camera.direction.x - camera.plane.x;
+            float rayDir0Y = camera.direction.y - camera.plane.y;
+            for (int y = 0; y < viewHeight; y++) {
+                float distance = rowDistance[y];
+                floorRows.startU[y] = (camera.position.x + distance * rayDir0X) * CELL_SIZE;
+                floorRows.startV[y] = (camera.position.y + distance * rayDir0Y) * CELL_SIZE;
+                floorRows.stepU[y] = distance * 2.0f * camera.plane.x / viewWidth * CELL_SIZE;
+                floorRows.stepV[y] = distance * 2.0f * camera.plane.y / viewWidth * CELL_SIZE;
+                floorRows.shade[y] = lightLevel(distance) * CELL_SIZE * CELL_SIZE;
+            }
+        }
+
+        RayCastParams params = { camera.position.x, camera.position.y, worldMap.solidBits(), worldMap.getWidth(),
+                                 worldMap.getHeight(), worldMap.getChunksY(), emptySpaceSkipping ? &occupancy : NULL,
+                                 maxViewDistance };
+
+        // When the camera only turned since the last frame, make sure the panorama covers
+        // the view, tracing the sectors it is missing across the pool
+        bool rotationOnly = panoramaEnabled && castValid &&
+                            camera.position.x == lastCastPosition.x && camera.position.y == lastCastPosition.y;
+        castValid = true;
+        lastCastPosition = camera.position;
+        if (rotationOnly) {
+            panorama.moveTo(camera.position.x, camera.position.y, mapVersion, maxViewDistance);
+            int missing = panorama.prepare(rayHits, rayWidth);
+            threadPool->parallelFor(missing, 1, [&](int begin, int end) {
+                PROFILE_SCOPE("trace panorama");
+                for (int i = begin; i < end; i++) {
+                    panorama.traceMissing(params, i, rayPacketWidth);
+                }
+            });
+        }
+
+        // Cast and draw the walls at reduced resolution, in strips of columns spread over the
+        // worker pool. Strips are whole packets wide and start on a zBuffer cache line, and
+        // there are several per thread so workers that finish early can steal the rest.
+        int stripAlign = max(rayPacketWidth, int(ceil(CACHE_LINE_SIZE / sizeof(float) / rayScale)));
+        int stripWidth = stripAlign * max(1, rayWidth / (threadPool->size() * 4 * stripAlign));
+        threadPool->parallelFor(rayWidth, stripWidth, [&](int begin, int end) {
+            {
+                PROFILE_SCOPE("cast rays");
+                if (rotationOnly) {
+                    panorama.resolve(params, rayHits, begin, end);
+                } else {
+                    castRays(params, rayHits, begin, end, rayPacketWidth);
+                }
+            }
+            PROFILE_SCOPE("draw columns");
+            if (palettized) {
+                drawWallColumns(begin, end, indexedTarget);
+            } else {
+                drawWallColumns(begin, end, sceneTarget);
+            }
+        });
+
+        // Render sprites (enemies). parallelFor doubles as the barrier here: it only returns
+        // once every strip is drawn, so the zBuffer and the hits are complete.
+        if (!snapshotView) markVisibleBuckets();
+        collectSprites();
+        if (palettized) {
+            drawSprites(indexedTarget, (const uint8_t*)NULL);
+        } else {
+            drawSprites(sceneTarget, (const uint8_t*)NULL);
+        }
+    }
+
+    // Mark the view columns of sprites that appeared, moved or disappeared since the
+    // last frame, widened to whole rays. Returns false if no sprite changed.
+    bool markSpriteColumns() {
+        fill(dirtyColumns.begin(), dirtyColumns.end(), 0);
+        bool changed = false;
+        for (int pass = 0; pass < 2; pass++) {
+            const vector<SpriteDraw>& from = pass == 0 ? spriteDraws : lastSpriteDraws;
+            const vector<SpriteDraw>& other = pass == 0 ? lastSpriteDraws : spriteDraws;
+            for (const SpriteDraw& sprite : from) {
+                if (find(other.begin(), other.end(), sprite) != other.end()) continue;
+                changed = true;
+                for (int x = max(sprite.startX, 0); x < min(sprite.endX, viewWidth); x++) {
+                    dirtyColumns[x] = 1;
+                }
+            }
+        }
+        if (!changed) return false;
+
+        // A ray redraws every column it covers, so a touched ray dirties all of them
+        for (int ray = 0; ray < rayWidth; ray++) {
+            int begin = ray * viewWidth / rayWidth, end = (ray + 1) * viewWidth / rayWidth;
+            if (find(dirtyColumns.begin() + begin, dirtyColumns.begin() + end, 1) != dirtyColumns.begin() + end) {
+                fill(dirtyColumns.begin() + begin, dirtyColumns.begin() + end, 1);
+            }
+        }
+        return true;
+    }
+
+    // Redraw the walls under the dirty columns from the last full frame's hits, then
+    // the sprites, clipped to those columns
+    void redrawDirtyColumns() {
+        PROFILE_SCOPE("redraw columns");
+        selectSceneTarget();
+        int ray = 0;
+        while (ray < rayWidth) {
+            if (!dirtyColumns[ray * viewWidth / rayWidth]) {
+                ray++;
+                continue;
+            }
+            int begin = ray;
+            while (ray < rayWidth && dirtyColumns[ray * viewWidth / rayWidth]) ray++;
+            if (palettized) {
+                drawWallColumns(begin, ray, indexedTarget);
+            } else {
+                drawWallColumns(begin, ray, sceneTarget);
+            }
+        }
+        if (palettized) {
+            drawSprites(indexedTarget, dirtyColumns.data());
+        } else {
+            drawSprites(sceneTarget, dirtyColumns.data());
+        }
+
+        // Every tile column showing a dirty view column has to be presented again
+        int tilesX = (screenWidth + PRESENT_TILE - 1) / PRESENT_TILE;
+        int tilesY = (screenHeight + PRESENT_TILE - 1) / PRESENT_TILE;
+        for (int x = 0; x < screenWidth; x++) {
+            if (!dirtyColumns[sourceColumn[x]]) continue;
+            for (int tileY = 0; tileY < tilesY; tileY++) {
+                dirtyTiles[tileY * tilesX + x / PRESENT_TILE] = 1;
+            }
+        }
+    }
+
+    // Mark the output tiles under a HUD rectangle for presenting
+    void markHudTiles(const HudRect& rect) {
+        int tilesX = (screenWidth + PRESENT_TILE - 1) / PRESENT_TILE;
+        for (int tileY = rect.y / PRESENT_TILE; tileY <= (rect.y + rect.height - 1) / PRESENT_TILE; tileY++) {
+            for (int tileX = rect.x / PRESENT_TILE; tileX <= (rect.x + rect.width - 1) / PRESENT_TILE; tileX++) {
+                dirtyTiles[tileY * tilesX + tileX] = 1;
+            }
+        }
+    }
+
+    // Draw the wall, floor and ceiling for rays [begin, end) from this frame's hits into
+    // target, which is ARGB (unsigned int) or palette indices (uint8_t)
+    template <typename Pixel>
+    void drawWallColumns(int begin, int end, Pixel* target) {
+        Pixel ceilingColor, floorColor, fogColor;
+        flatColors(ceilingColor, floorColor, fogColor);
+        const Pixel* ceilingTexture;
+        const Pixel* floorTexture;
+        surfaceTextures(ceilingTexture, floorTexture);
+        Pixel lit[CELL_SIZE];
+
+        for (int x = begin; x < end; x++) {
+            Vec2 rayDir = Vec2(rayHits.rayDirX[x], rayHits.rayDirY[x]);
+            int side = rayHits.side[x];
+            float perpWallDist = rayHits.perpWallDist[x];
+
+            // A ray that found no wall in range draws a band of fog at the view distance
+            bool fog = side == RAY_MISS;
+
+            // Add minimum distance check to prevent wall wiggling
+            perpWallDist = max(perpWallDist, 0.05f);
+
+            // Calculate height of wall slice to draw
+            int lineHeight = int(viewHeight / perpWallDist);
+
+            // Cap maximum wall height to prevent extreme distortion
+            lineHeight = min(lineHeight, viewHeight * 10);
+
+            // Calculate lowest and highest pixel to draw
+            int drawStart = -lineHeight / 2 + viewHeight / 2;
+            if (drawStart < 0) drawStart = 0;
+            int drawEnd = lineHeight / 2 + viewHeight / 2;
+            if (drawEnd >= viewHeight) drawEnd = viewHeight - 1;
+
+            // Texture calculations
+            float wallX;
+            if (side == 0) {
+                wallX = camera.position.y + perpWallDist * rayDir.y;
+            } else {
+                wallX = camera.position.x + perpWallDist * rayDir.x;
+            }
+            wallX -= floor(wallX);
+
+            // X coordinate in the texture
+            int texX = int(wallX * CELL_SIZE);
+            if (side == 0 && rayDir.x > 0) texX = CELL_SIZE - texX - 1;
+            if (side == 1 && rayDir.y < 0) texX = CELL_SIZE - texX - 1;
+
+            // Texels of this wall slice, top to bottom, already shaded for its side and distance
+            const Pixel* texColumn = fog ? NULL : litColumn(wallShades, wallIndexed, side, lightLevel(perpWallDist), texX, lit);
+
+            // Texel row for every screen row of the slice. Comes from the scaler cache, or is
+            // stepped out in 16.16 fixed point when the cache budget is spent.
+            int sliceHeight = drawEnd - drawStart;
+            const uint16_t* texRows = NULL;
+            if (sliceHeight > 0 && !fog) {
+                texRows = columnScalers.get(lineHeight, sliceHeight);
+                if (!texRows) {
+                    static thread_local vector<uint16_t> stepped;
+                    stepped.resize(sliceHeight);
+                    unsigned long long texStep = (static_cast<unsigned long long>(CELL_SIZE) << 16) / lineHeight;
+                    unsigned long long texPos = 0;
+                    for (int i = 0; i < sliceHeight; i++) {
+                        stepped[i] = uint16_t(texPos >> 16);
+                        texPos += texStep;
+                    }
+                    texRows = stepped.data();
+                }
+            }
+
+            // Draw the wall slice in each view column this ray covers
+            int columnEnd = (x + 1) * viewWidth / rayWidth;
+            for (int screenX = x * viewWidth / rayWidth; screenX < columnEnd; screenX++) {
+                Pixel* column = target + screenX * targetStrideX;
+
+                // Store depth information for sprite rendering
+                zBuffer[screenX] = perpWallDist;
+
+                // Draw the wall slice
+                Pixel* slice = column + drawStart * targetStrideY;
+                if (fog) {
+                    for (int i = 0; i < sliceHeight; i++) {
+                        slice[i * targetStrideY] = fogColor;
+                    }
+                } else {
+                    for (int i = 0; i < sliceHeight; i++) {
+                        slice[i * targetStrideY] = texColumn[texRows[i]];
+                    }
+                }
+
+                // Draw floor and ceiling. The slice covers rows [drawStart, drawEnd), so the
+                // floor starts at drawEnd; no row of the column is left over from the last frame.
+                if (texturedFloor) {
+                    castFloorSpan(floorRows, 0, drawStart, screenX, ceilingTexture, column, targetStrideY);
+                    castFloorSpan(floorRows, drawEnd, viewHeight, screenX, floorTexture, column, targetStrideY);
+                    continue;
+                }
+                for (int y = 0; y < drawStart; y++) {
+                    column[y * targetStrideY] = ceilingColor;
+                }
+                for (int y = drawEnd; y < viewHeight; y++) {
+                    column[y * targetStrideY] = floorColor;
+                }
+            }
+        }
+    }
+
+    // Pixel (x, y) of the 3D view in the current frame's target layout
+    template <typename Pixel>
+    Pixel& scenePixel(Pixel* target, int x, int y) {
+        return target[x * targetStrideX + y * targetStrideY];
+    }
+
+    // Mark the enemy grid buckets along every ray of this frame's hits, from the
+    // player to the wall it hit or SPRITE_RANGE, whichever is nearer. Any enemy
+    // whose sprite can show is in one of them or a neighbour. Stays valid for as
+    // long as the hits do.
+    void markVisibleBuckets() {
+        PROFILE_SCOPE("mark buckets");
+        enemyGrid.beginMarking();
+        for (int x = 0; x < rayWidth; x++) {
+            float rayDirX = rayHits.rayDirX[x], rayDirY = rayHits.rayDirY[x];
+            float reach = SPRITE_RANGE / sqrt(rayDirX * rayDirX + rayDirY * rayDirY);
+            float t = min(rayHits.perpWallDist[x], reach);
+            enemyGrid.markSegment(camera.position.x, camera.position.y,
+                                  camera.position.x + rayDirX * t, camera.position.y + rayDirY * t);
+        }
+    }
+
+    // Project the visible enemies into spriteDraws, ordered far to near. Only the
+    // enemies in buckets marked by markVisibleBuckets() are considered, or on
+    // snapshot frames the ones the snapshots hold.
+    void collectSprites() {
+        PROFILE_SCOPE("collect sprites");
+        spriteDraws.clear();
+        if (!snapshotView) {
+            spriteSources.clear();
+            for (int bucket : enemyGrid.markedBuckets()) {
+                enemyGrid.forEachInBucket(bucket, [&](int i) {
+                    spriteSources.push_back(SpriteSource{enemies.tag[i], enemies.x[i], enemies.y[i]});
+                });
+            }
+        }
+
+        // Only process visible enemies
+        vector<pair<float, int>> spriteOrder;
+
+        for (int i = 0; i < int(spriteSources.size()); i++) {
+            // Skip processing for enemies that are far away
+            float dx = spriteSources[i].x - camera.position.x;
+            float dy = spriteSources[i].y - camera.position.y;
+            float dist = dx*dx + dy*dy;
+
+            if (dist > SPRITE_RANGE * SPRITE_RANGE) continue; // Skip distant enemies
+
+            spriteOrder.push_back(make_pair(dist, i));
+        }
+
+        // Sort enemies by distance (for correct transparency); the tag breaks ties so
+        // the order doesn't depend on how the grid lists them
+        {
+            PROFILE_SCOPE("sort sprites");
+            sort(spriteOrder.begin(), spriteOrder.end(),
+                 [&](const pair<float, int>& a, const pair<float, int>& b) {
+                     if (a.first != b.first) return a.first > b.first;  // Sort from far to near
+                     return spriteSources[a.second].tag > spriteSources[b.second].tag;
+                 });
+        }
+
+        for (auto& pair : spriteOrder) {
+            const SpriteSource& source = spriteSources[pair.second];
+            // Calculate sprite position relative to player
+            float spriteX = source.x - camera.position.x;
+            float spriteY = source.y - camera.position.y;
+
+            // Transform sprite with the inverse camera matrix
+            float invDet = 1.0f / (camera.plane.x * camera.direction.y - camera.direction.x * camera.plane.y);
+            float transformX = invDet * (camera.direction.y * spriteX - camera.direction.x * spriteY);
+            float transformY = invDet * (-camera.plane.y * spriteX + camera.plane.x * spriteY);
+
+            // Sprite is behind the camera
+            if (transformY <= 0.1f) continue;
+
+            SpriteDraw sprite;
+            sprite.enemy = int(source.tag);
+            sprite.depth = transformY;
+
+            // Calculate sprite screen position
+            sprite.screenX = int((viewWidth / 2) * (1 + transformX / transformY));
+
+            // Calculate sprite height and width
+            sprite.height = abs(int(viewHeight / transformY));
+            sprite.width = abs(int(viewHeight / transformY));
+
+            // Scale down large sprites for performance
+            if (sprite.height > viewHeight * 2) sprite.height = viewHeight * 2;
+            if (sprite.width > viewWidth * 2) sprite.width = viewWidth * 2;
+
+            // Calculate drawing bounds
+            sprite.startY = -sprite.height / 2 + viewHeight / 2;
+            if (sprite.startY < 0) sprite.startY = 0;
+            sprite.endY = sprite.height / 2 + viewHeight / 2;
+            if (sprite.endY >= viewHeight) sprite.endY = viewHeight - 1;
+
+            sprite.startX = -sprite.width / 2 + sprite.screenX;
+            if (sprite.startX < 0) sprite.startX = 0;
+            sprite.endX = sprite.width / 2 + sprite.screenX;
+            if (sprite.endX >= viewWidth) sprite.endX = viewWidth - 1;
+
+            // Skip drawing sprites that are off-screen
+            if (sprite.endX < 0 || sprite.startX >= viewWidth) continue;
+
+            spriteDraws.push_back(sprite);
+        }
+    }
+
+    // Draw this frame's sprites from furthest to nearest. With a column mask, only
+    // view columns whose mask entry is set are written.
+    template <typename Pixel>
+    void drawSprites(Pixel* target, const uint8_t* columnMask) {
+        PROFILE_SCOPE("draw sprites");
+        Pixel lit[CELL_SIZE];
+
+        for (const SpriteDraw& sprite : spriteDraws) {
+            int spriteWidth = sprite.width;
+            int spriteHeight = sprite.height;
+            int drawStartX = sprite.startX, drawEndX = sprite.endX;
+            int drawStartY = sprite.startY, drawEndY = sprite.endY;
+            float transformY = sprite.depth;
+
+            // Optimization: Increase stepping to draw fewer pixels of the sprite
+            int step = 1;
+            if (spriteHeight > viewHeight / 2) step = 2; // Use larger steps for large sprites
+
+            // Loop through every pixel of the sprite (with optimization step)
+            for (int x = drawStartX; x < drawEndX; x += step) {
+                // Bounds check
+                if (x < 0 || x >= viewWidth) continue;
+
+                // Check if sprite is behind a wall
+                if (transformY > zBuffer[x]) continue;
+
+                // With step > 1 each texel also covers the next column, to avoid a checkerboard effect
+                bool drawColumn = !columnMask || columnMask[x];
+                bool drawNext = step > 1 && x + 1 < drawEndX && x + 1 < viewWidth && (!columnMask || columnMask[x + 1]);
+                if (!drawColumn && !drawNext) continue;
+
+                int texX = int((x - (-spriteWidth / 2 + sprite.screenX)) * CELL_SIZE / spriteWidth);
+                const Pixel* texColumn = litColumn(enemyShades, enemyIndexed, 0, lightLevel(transformY), texX, lit);
+
+                for (int y = drawStartY; y < drawEndY; y += step) {
+                    if (y < 0 || y >= viewHeight) continue;
+
+                    int texY = int((y - drawStartY) * CELL_SIZE / spriteHeight);
+                    Pixel texel = texColumn[texY];
+
+                    // Only draw non-transparent pixels, filling the gap below too if step > 1
+                    if (isOpaque(texel)) {
+                        bool fillBelow = step > 1 && y + 1 < drawEndY && y + 1 < viewHeight;
+                        if (drawColumn) {
+                            scenePixel(target, x, y) = texel;
+                            if (fillBelow) scenePixel(target, x, y + 1) = texel;
+                        }
+                        if (drawNext) {
+                            scenePixel(target, x + 1, y) = texel;
+                            if (fillBelow) scenePixel(target, x + 1, y + 1) = texel;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Queue a HUD rectangle for this frame, clipped to the screen
+    void addHudRect(int x, int y, int width, int height, unsigned int color) {
+        int x0 = max(x, 0), y0 = max(y, 0);
+        int x1 = min(x + width, screenWidth), y1 = min(y + height, screenHeight);
+        if (x0 >= x1 || y0 >= y1) return;
+        HudRect rect = { x0, y0, x1 - x0, y1 - y0, color };
+        hudRects.push_back(rect);
+    }
+
+    // Lay out the HUD as a list of solid rectangles. They are drawn over the 3D view by
+    // present(), in order, so later rectangles cover earlier ones.
+    void renderHUD() {
+        PROFILE_SCOPE("hud");
+        hudRects.clear();
+
+        // Draw health bar
+        int healthBarWidth = 200;
+        int healthBarHeight = 20;
+        int healthBarX = 20;
+        int healthBarY = screenHeight - 40;
+
+        // Health bar background
+        addHudRect(healthBarX, healthBarY, healthBarWidth, healthBarHeight, 0xFF222222);
+
+        // Health bar fill
+        int fillWidth = (camera.health * healthBarWidth) / 100;
+        addHudRect(healthBarX, healthBarY, fillWidth, healthBarHeight, 0xFF00FF00);
+
+        // Weapon crosshair
+        if (camera.hasWeapon) {
+            int crosshairSize = 10;
+            int centerX = screenWidth / 2;
+            int centerY = screenHeight / 2;
+
+            addHudRect(centerX - crosshairSize, centerY, crosshairSize * 2 + 1, 1, 0xFFFFFFFF);
+            addHudRect(centerX, centerY - crosshairSize, 1, crosshairSize * 2 + 1, 0xFFFFFFFF);
+        }
+
+        // Draw game over text if needed
+        if (viewGameOver) {
+            int textWidth = 9 * 20;  // Approximate width of "GAME OVER"
+            int textX = (screenWidth - textWidth) / 2;
+            int textY = screenHeight / 2;
+
+            addHudRect(textX, textY, textWidth, 40, 0xFFFF0000);
+        }
+    }
+
+    // Fill the part of a HUD rectangle that falls inside [x0, x1) x [y0, y1) of renderBuffer
+    void fillHudRect(const HudRect& rect, int x0, int y0, int x1, int y1) {
+        x0 = max(x0, rect.x);
+        y0 = max(y0, rect.y);
+        x1 = min(x1, rect.x + rect.width);
+        y1 = min(y1, rect.y + rect.height);
+        for (int y = y0; y < y1; y++) {
+            unsigned int* row = renderBuffer + y * screenWidth;
+            for (int x = x0; x < x1; x++) {
+                row[x] = rect.color;
+            }
+        }
+    }
+
+    // Finish the frame in renderBuffer. A column-major 3D view is transposed in
+    // cache-sized tiles, and each tile gets its share of the HUD composited while
+    // it is still in cache; a row-major view only needs the HUD drawn over it.
+    // An 8-bit view is expanded through the palette in the same pass: row-major
+    // rows straight into renderBuffer, column-major tiles into an L1-sized scratch
+    // tile that is then transposed. A view rendered below the output resolution is
+    // upscaled (nearest neighbour) on the way through the same scratch tile.
+    // With onlyDirty, tiles not marked in dirtyTiles (or row bands without a marked
+    // tile) are left as they are in renderBuffer.
+    void present(bool onlyDirty = false) {
+        PROFILE_SCOPE("present");
+        bool scaled = viewWidth != screenWidth || viewHeight != screenHeight;
+        if (!columnMajorTarget && !palettized) {
+            if (scaled) upscaleInPlace();
+            for (const HudRect& rect : hudRects) {
+                fillHudRect(rect, 0, 0, screenWidth, screenHeight);
+            }
+            return;
+        }
+
+        const int TILE = PRESENT_TILE;
+        int tileRows = (screenHeight + TILE - 1) / TILE;
+        int tileColumns = (screenWidth + TILE - 1) / TILE;
+        threadPool->parallelFor(tileRows, 1, [&](int begin, int end) {
+            alignas(CACHE_LINE_SIZE) unsigned int expanded[TILE * TILE];
+            for (int tileY = begin; tileY < end; tileY++) {
+                int y0 = tileY * TILE;
+                int y1 = min(y0 + TILE, screenHeight);
+                const uint8_t* dirtyRow = &dirtyTiles[tileY * tileColumns];
+                if (!columnMajorTarget) {
+                    if (onlyDirty && find(dirtyRow, dirtyRow + tileColumns, 1) == dirtyRow + tileColumns) continue;
+                    for (int y = y0; y < y1; y++) {
+                        const uint8_t* source = indexedBuffer + sourceRow[y] * screenWidth;
+                        unsigned int* row = renderBuffer + y * screenWidth;
+                        if (viewWidth == screenWidth) {
+                            expandPixels(source, row, screenWidth, palette.colors());
+                        } else {
+                            for (int x = 0; x < screenWidth; x++) {
+                                row[x] = palette.color(source[sourceColumn[x]]);
+                            }
+                        }
+                    }
+                    for (const HudRect& rect : hudRects) {
+                        fillHudRect(rect, 0, y0, screenWidth, y1);
+                    }
+                    continue;
+                }
+                for (int x0 = 0; x0 < screenWidth; x0 += TILE) {
+                    int x1 = min(x0 + TILE, screenWidth);
+                    if (onlyDirty && !dirtyRow[x0 / TILE]) continue;
+                    if (scaled) {
+                        for (int x = x0; x < x1; x++) {
+                            unsigned int* out = expanded + (x - x0) * TILE;
+                            if (palettized) {
+                                upscaleColumn(indexedBuffer + sourceColumn[x] * indexedColumnStride, out, y0, y1);
+                            } else {
+                                upscaleColumn(sceneBuffer + sourceColumn[x] * sceneColumnStride, out, y0, y1);
+                            }
+                        }
+                        transposeBlock(expanded, TILE, renderBuffer + y0 * screenWidth + x0, screenWidth, x1 - x0, y1 - y0);
+                    } else if (palettized) {
+                        for (int x = x0; x < x1; x++) {
+                            expandPixels(indexedBuffer + x * indexedColumnStride + y0, expanded + (x - x0) * TILE,
+                                         y1 - y0, palette.colors());
+                        }
+                        transposeBlock(expanded, TILE, renderBuffer + y0 * screenWidth + x0, screenWidth, x1 - x0, y1 - y0);
+                    } else {
+                        transposeBlock(sceneBuffer + x0 * sceneColumnStride + y0, sceneColumnStride,
+                                       renderBuffer + y0 * screenWidth + x0, screenWidth, x1 - x0, y1 - y0);
+                    }
+                    for (const HudRect& rect : hudRects) {
+                        fillHudRect(rect, x0, y0, x1, y1);
+                    }
+                }
+            }
+        });
+    }
+
+    // Output rows [y0, y1) of a view column, upscaled and in ARGB
+    void upscaleColumn(const unsigned int* column, unsigned int* out, int y0, int y1) const {
+        for (int y = y0; y < y1; y++) {
+            out[y - y0] = column[sourceRow[y]];
+        }
+    }
+
+    void upscaleColumn(const uint8_t* column, unsigned int* out, int y0, int y1) const {
+        const unsigned int* colors = palette.colors();
+        for (int y = y0; y < y1; y++) {
+            out[y - y0] = colors[column[sourceRow[y]]];
+        }
+    }
+
+    // Stretch a row-major view in the top-left corner of renderBuffer over the whole
+    // buffer. Every output pixel comes from a view pixel at or above and left of it,
+    // so walking backwards from the last pixel never reads one already overwritten.
+    void upscaleInPlace() {
+        for (int y = screenHeight - 1; y >= 0; y--) {
+            const unsigned int* source = renderBuffer + sourceRow[y] * screenWidth;
+            unsigned int* row = renderBuffer + y * screenWidth;
+            for (int x = screenWidth - 1; x >= 0; x--) {
+                row[x] = source[sourceColumn[x]];
+            }
+        }
+    }
+
+    // Everything the current frame's wall layer depends on
+    SceneKey currentSceneKey() const {
+        SceneKey key;
+        key.position = camera.position;
+        key.direction = camera.direction;
+        key.plane = camera.plane;
+        key.mapVersion = mapVersion;
+        key.viewWidth = viewWidth;
+        key.viewHeight = viewHeight;
+        key.palettized = palettized;
+        key.columnMajor = columnMajorTarget;
+        key.texturedFloor = texturedFloor;
+        key.distanceShading = distanceShading;
+        key.maxViewDistance = maxViewDistance;
+        return key;
+    }
+
+    // Render a frame into renderBuffer. Presenting it is up to the caller. Returns false
+    // if the frame is identical to the last one, in which case renderBuffer is untouched
+    // and there is nothing new to present.
+    //
+    // With frame caching, the wall/floor/ceiling layer is only drawn again when something
+    // it depends on (SceneKey) changes. Otherwise just the columns under sprites that
+    // appeared, moved or went away are redrawn, and only the tiles showing them or a
+    // changed part of the HUD are presented again.
+    bool render() {
+        camera = player;
+        viewGameOver = gameOver;
+        snapshotView = false;
+        return renderView();
+    }
+
+    // Render a frame between two simulation snapshots, for a renderer running apart
+    // from the simulation (simulation.h): the player and enemies are blended alpha of
+    // the way from `from` to `to`. Touches nothing the simulation writes, so it may
+    // run while another thread calls update(). Enemies only in `to` are drawn where
+    // they are; enemies gone from `to` are not drawn.
+    bool renderInterpolated(const SimSnapshot& from, const SimSnapshot& to, float alpha) {
+        alpha = max(0.0f, min(alpha, 1.0f));
+        const Player& a = from.player;
+        const Player& b = to.player;
+        camera = b;
+        camera.position = Vec2(a.position.x + (b.position.x - a.position.x) * alpha,
+                               a.position.y + (b.position.y - a.position.y) * alpha);
+        // Blend the view direction and keep it unit length, with the plane at right angles
+        Vec2 direction(a.direction.x + (b.direction.x - a.direction.x) * alpha,
+                       a.direction.y + (b.direction.y - a.direction.y) * alpha);
+        float length = direction.length();
+        if (length > 0) {
+            float planeLength = b.plane.length();
+            float sign = b.direction.x * b.plane.y - b.direction.y * b.plane.x < 0 ? -1.0f : 1.0f;
+            camera.direction = Vec2(direction.x / length, direction.y / length);
+            camera.plane = Vec2(-camera.direction.y * planeLength * sign, camera.direction.x * planeLength * sign);
+        }
+        viewGameOver = to.gameOver;
+
+        // Both lists are ordered by tag
+        spriteSources.clear();
+        size_t j = 0;
+        for (const SpriteSource& next : to.sprites) {
+            while (j < from.sprites.size() && from.sprites[j].tag < next.tag) j++;
+            SpriteSource blended = next;
+            if (j < from.sprites.size() && from.sprites[j].tag == next.tag) {
+                blended.x = from.sprites[j].x + (next.x - from.sprites[j].x) * alpha;
+                blended.y = from.sprites[j].y + (next.y - from.sprites[j].y) * alpha;
+            }
+            spriteSources.push_back(blended);
+        }
+        snapshotView = true;
+        return renderView();
+    }
+
+    // Copy what rendering needs after this update into a snapshot: the player, and
+    // the enemies within SPRITE_RANGE of them (with a cell to spare, as the view
+    // may be blended toward the next tick) ordered by tag
+    void captureSnapshot(SimSnapshot& snapshot) const {
+        snapshot.player = player;
+        snapshot.gameOver = gameOver;
+        snapshot.sprites.clear();
+        float reach = SPRITE_RANGE + 1.0f;
+        enemyGrid.forEachNear(player.position.x, player.position.y, reach, [&](int i) {
+            float dx = enemies.x[i] - player.position.x;
+            float dy = enemies.y[i] - player.position.y;
+            if (dx * dx + dy * dy > reach * reach) return;
+            snapshot.sprites.push_back(SpriteSource{enemies.tag[i], enemies.x[i], enemies.y[i]});
+        });
+        sort(snapshot.sprites.begin(), snapshot.sprites.end(),
+             [](const SpriteSource& a, const SpriteSource& b) { return a.tag < b.tag; });
+    }
+
+private:
+    // Render camera and spriteSources' frame; see render()
+    bool renderView() {
+        PROFILE_SCOPE("render");
+        // Pick this frame's view size from the cost of the frames before it
+        if (resolution.isEnabled()) {
+            float scale = resolution.getScale();
+            int height = resolution.scalesHeight() ? int(screenHeight * scale) : screenHeight;
+            setViewSize(int(screenWidth * scale), height);
+        }
+
+        // Work out what this frame shows: the HUD on top of the view. Sprites are
+        // gathered from the rays, so after casting on a full frame, and from the
+        // last full frame's rays otherwise.
+        renderHUD();
+
+        SceneKey key = currentSceneKey();
+        bool cacheable = frameCaching && (columnMajorTarget || palettized);
+        if (!cacheable || !sceneValid || !(key == sceneKey)) {
+            // Render the whole 3D scene. Only full frames feed the resolution
+            // controller; partial ones say nothing about the cost of the view.
+            auto sceneStart = chrono::steady_clock::now();
+            renderScene();
+            sceneTime = chrono::duration<double, milli>(chrono::steady_clock::now() - sceneStart).count();
+            resolution.update(sceneTime);
+            present();
+            targetStale = false;
+            sceneKey = key;
+            sceneValid = cacheable;
+            frameStats.full++;
+        } else {
+            collectSprites();
+            fill(dirtyTiles.begin(), dirtyTiles.end(), 0);
+            bool spritesChanged = markSpriteColumns();
+            bool hudChanged = hudRects != lastHudRects;
+            if (!spritesChanged && !hudChanged) {
+                frameStats.skipped++;
+                return false;
+            }
+            if (spritesChanged) {
+                redrawDirtyColumns();
+            }
+            if (hudChanged) {
+                for (const HudRect& rect : lastHudRects) markHudTiles(rect);
+                for (const HudRect& rect : hudRects) markHudTiles(rect);
+            }
+            present(!targetStale);
+            targetStale = false;
+            frameStats.partial++;
+        }
+
+        lastSpriteDraws = spriteDraws;
+        lastHudRects = hudRects;
+        return true;
+    }
+
+    // Initialize in constructor
+    void initTrigTables() {
+        for (int i = 0; i < ANGLE_TABLE_SIZE; i++) {
+            float angle = 2.0f * M_PI * i / ANGLE_TABLE_SIZE;
+            sinTable[i] = sin(angle);
+            cosTable[i] = cos(angle);
+        }
+    }
+};
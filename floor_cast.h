@@ -0,0 +1,119 @@
+#pragma once
+
+// Textured floor and ceiling casting. Every pixel of screen row y sees the
+// floor (below the horizon) or the ceiling (above it) at the same distance,
+// so the world-space start and per-column step are worked out once per row
+// per frame. Drawing a pixel is then a multiply-add, a wrap into the texture
+// and a fetch. The 3D view is drawn a column at a time, so spans run down a
+// column through the per-row tables, eight rows per AVX2 step.
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLOOR_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Per-row casting parameters for one frame, in texel units of a square,
+// power-of-two texture stored column-major (texel (u, v) at u * textureSize + v)
+struct FloorRows {
+    std::vector<float> startU, startV;  // Texel coordinates at screen column 0
+    std::vector<float> stepU, stepV;    // Change per screen column
+    std::vector<int> shade;             // Offset of the row's light level in the texture array
+    int textureSize;
+
+    FloorRows() : textureSize(1) {}
+
+    void resize(int rows) {
+        startU.resize(rows);
+        startV.resize(rows);
+        stepU.resize(rows);
+        stepV.resize(rows);
+        shade.resize(rows);
+    }
+};
+
+// Texel index for row y at screen column x
+inline int floorTexel(const FloorRows& rows, int y, float x) {
+    float u = rows.startU[y] + x * rows.stepU[y];
+    float v = rows.startV[y] + x * rows.stepV[y];
+    int mask = rows.textureSize - 1;
+    int tu = int(floorf(u)) & mask;
+    int tv = int(floorf(v)) & mask;
+    return rows.shade[y] + tu * rows.textureSize + tv;
+}
+
+#ifdef FLOOR_X86_SIMD
+// Texel indices for rows y..y+7 at screen column x, same operations as floorTexel
+__attribute__((target("avx2")))
+inline __m256i floorTexels8(const FloorRows& rows, int y, __m256 x) {
+    __m256 u = _mm256_add_ps(_mm256_loadu_ps(&rows.startU[y]), _mm256_mul_ps(x, _mm256_loadu_ps(&rows.stepU[y])));
+    __m256 v = _mm256_add_ps(_mm256_loadu_ps(&rows.startV[y]), _mm256_mul_ps(x, _mm256_loadu_ps(&rows.stepV[y])));
+    __m256i mask = _mm256_set1_epi32(rows.textureSize - 1);
+    __m256i tu = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_floor_ps(u)), mask);
+    __m256i tv = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_floor_ps(v)), mask);
+    __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(tu, _mm256_set1_epi32(rows.textureSize)), tv);
+    return _mm256_add_epi32(index, _mm256_loadu_si256((const __m256i*)&rows.shade[y]));
+}
+
+__attribute__((target("avx2")))
+inline int castFloorSpanAVX2(const FloorRows& rows, int y0, int y1, int screenX, const unsigned int* texture,
+                             unsigned int* column, int stride) {
+    __m256 x = _mm256_set1_ps(float(screenX));
+    int y = y0;
+    for (; y + 8 <= y1; y += 8) {
+        __m256i texels = _mm256_i32gather_epi32((const int*)texture, floorTexels8(rows, y, x), 4);
+        if (stride == 1) {
+            _mm256_storeu_si256((__m256i*)(column + y), texels);
+        } else {
+            alignas(32) unsigned int run[8];
+            _mm256_store_si256((__m256i*)run, texels);
+            for (int i = 0; i < 8; i++) column[(y + i) * stride] = run[i];
+        }
+    }
+    return y;
+}
+
+// 8-bit textures are gathered as 32-bit words and narrowed, so the texture
+// array needs 3 bytes of padding past its last texel
+__attribute__((target("avx2")))
+inline int castFloorSpanAVX2(const FloorRows& rows, int y0, int y1, int screenX, const uint8_t* texture,
+                             uint8_t* column, int stride) {
+    __m256 x = _mm256_set1_ps(float(screenX));
+    int y = y0;
+    for (; y + 8 <= y1; y += 8) {
+        __m256i words = _mm256_i32gather_epi32((const int*)texture, floorTexels8(rows, y, x), 1);
+        words = _mm256_and_si256(words, _mm256_set1_epi32(0xFF));
+        __m128i shorts = _mm_packus_epi32(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+        __m128i bytes = _mm_packus_epi16(shorts, shorts);
+        if (stride == 1) {
+            _mm_storel_epi64((__m128i*)(column + y), bytes);
+        } else {
+            alignas(16) uint8_t run[16];
+            _mm_store_si128((__m128i*)run, bytes);
+            for (int i = 0; i < 8; i++) column[(y + i) * stride] = run[i];
+        }
+    }
+    return y;
+}
+#endif // FLOOR_X86_SIMD
+
+// Draw rows [y0, y1) of screen column screenX from texture (all light levels,
+// see FloorRows::shade) into column, whose rows are stride pixels apart
+template <typename Pixel>
+inline void castFloorSpan(const FloorRows& rows, int y0, int y1, int screenX, const Pixel* texture,
+                          Pixel* column, int stride) {
+    int y = y0;
+#ifdef FLOOR_X86_SIMD
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (hasAVX2) {
+        y = castFloorSpanAVX2(rows, y0, y1, screenX, texture, column, stride);
+    }
+#endif
+    float x = float(screenX);
+    for (; y < y1; y++) {
+        column[y * stride] = texture[floorTexel(rows, y, x)];
+    }
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+// Shared pathfinding for every enemy. A breadth-first search spreads out from
+// the target cells (normally just the player's) over the open cells of the
+// map, and each cell it reaches records which neighbour it was reached from:
+// the next step on a shortest path to the nearest target. An enemy reads its
+// cell's entry and heads for that neighbour, so a path costs one byte lookup
+// per enemy however many enemies share it.
+//
+// The search is bounded to FLOW_FIELD_RANGE steps and kept in a window that
+// covers just those, so neither its cost nor its memory grows with the map. Enemies beyond it, or in cells it couldn't reach, walk
+// straight at the player as before. A FlowFieldBuilder can run searches on a
+// thread of its own and hands over each finished field whole, so enemies
+// never see a half-built one.
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <algorithm>
+#include "world_map.h"
+#include "profiler.h"
+
+// Steps the search spreads from its targets
+const int FLOW_FIELD_RANGE = 128;
+
+// Entries besides directions 0-7
+const uint8_t FLOW_TARGET = 8;     // A target cell: head for the target itself
+const uint8_t FLOW_WALL = 0xFE;    // A wall
+const uint8_t FLOW_NONE = 0xFF;    // Not reached: cut off or out of range
+
+// Neighbour offsets by direction. Straight moves come first so the search
+// prefers them on ties, and every direction's opposite is d ^ 1.
+const int FLOW_DX[8] = {1, -1, 0, 0, 1, -1, 1, -1};
+const int FLOW_DY[8] = {0, 0, 1, -1, 1, -1, -1, 1};
+
+struct FlowTarget {
+    int x, y;
+};
+
+struct FlowField {
+    int originX, originY;     // Map cell at the window's first entry
+    int width, height;        // Window the search could reach: its targets' bounds, grown by the range and a wall
+    int version;              // Map version the field was searched on
+    std::vector<uint8_t> next; // Per window cell (x * height + y): direction of the next step, FLOW_TARGET, FLOW_NONE or FLOW_WALL
+    std::vector<int> reached;  // Window cells the last search reached, in order, targets first
+
+    FlowField() : originX(0), originY(0), width(0), height(0), version(-1) {}
+
+    // Entry for map cell (x, y); FLOW_NONE outside the window
+    uint8_t at(int x, int y) const {
+        x -= originX;
+        y -= originY;
+        if (x < 0 || y < 0 || x >= width || y >= height) return FLOW_NONE;
+        return next[size_t(x) * height + y];
+    }
+
+    // Search from the open targets over the map's open cells, at most range
+    // steps. Diagonal steps need both cells beside them open, so paths don't
+    // cut wall corners. Walls are marked in the field before the search, so a
+    // step tests one byte for both walls and cells already reached. The window
+    // reaches one cell past the range, or to the map's solid border, so every
+    // cell the search steps to is inside it.
+    void build(const WorldMap& map, const std::vector<FlowTarget>& targets, int mapVersion, int range) {
+        PROFILE_SCOPE("flow field search");
+        version = mapVersion;
+        reached.clear();
+        int minX = map.getWidth(), minY = map.getHeight(), maxX = -1, maxY = -1;
+        for (const FlowTarget& t : targets) {
+            if (!map.inside(t.x, t.y) || map.solid(t.x, t.y)) continue;
+            minX = std::min(minX, t.x);
+            minY = std::min(minY, t.y);
+            maxX = std::max(maxX, t.x);
+            maxY = std::max(maxY, t.y);
+        }
+        if (maxX < 0) {
+            width = height = 0;
+            return;
+        }
+        originX = std::max(minX - range - 1, -MAP_BORDER);
+        originY = std::max(minY - range - 1, -MAP_BORDER);
+        width = std::min(maxX + range + 2, map.getWidth() + MAP_BORDER) - originX;
+        height = std::min(maxY + range + 2, map.getHeight() + MAP_BORDER) - originY;
+        // Three bytes of padding let a SIMD gather read a whole word at the last cell
+        next.resize(size_t(width) * height + 3);
+        const uint32_t* solid = map.solidBits();
+        int chunksY = map.getChunksY();
+        for (int x = 0; x < width; x++) {
+            uint8_t* column = &next[size_t(x) * height];
+            for (int y = 0; y < height; y++) {
+                column[y] = mapSolid(solid, originX + x, originY + y, chunksY) ? FLOW_WALL : FLOW_NONE;
+            }
+        }
+
+        for (const FlowTarget& t : targets) {
+            if (!map.inside(t.x, t.y)) continue;
+            int cell = (t.x - originX) * height + (t.y - originY);
+            if (next[cell] != FLOW_NONE) continue;
+            next[cell] = FLOW_TARGET;
+            reached.push_back(cell);
+        }
+
+        int offset[8];
+        for (int d = 0; d < 8; d++) offset[d] = FLOW_DX[d] * height + FLOW_DY[d];
+        size_t head = 0;
+        for (int step = 0; step < range && head < reached.size(); step++) {
+            size_t layerEnd = reached.size();
+            for (; head < layerEnd; head++) {
+                int from = reached[head];
+                for (int d = 0; d < 8; d++) {
+                    int cell = from + offset[d];
+                    if (next[cell] != FLOW_NONE) continue;
+                    if (d >= 4 && (next[from + FLOW_DX[d] * height] == FLOW_WALL || next[from + FLOW_DY[d]] == FLOW_WALL)) continue;
+                    next[cell] = uint8_t(d ^ 1); // Back the way the search came
+                    reached.push_back(cell);
+                }
+            }
+        }
+    }
+};
+
+// Runs flow field searches, on a worker thread or inline. request() asks for
+// a search; current() returns the newest finished field. A threaded search
+// reads the map while it runs, so call finish() before changing the map.
+class FlowFieldBuilder {
+private:
+    FlowField fields[2];
+    int published;            // Field current() returns, -1 if none yet
+    bool ready;               // The other field holds a finished search not yet published
+
+    // Latest request, taken by the worker when it's free
+    const WorldMap* map;
+    std::vector<FlowTarget> targets;
+    int mapVersion;
+    bool pending;
+    bool busy;
+    bool stopping;
+    bool threaded;
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+
+    void workerLoop() {
+        PROFILE_THREAD("flow field");
+        std::vector<FlowTarget> job;
+        while (true) {
+            int version;
+            FlowField* field;
+            const WorldMap* source;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || pending; });
+                if (stopping) return;
+                job = targets;
+                version = mapVersion;
+                source = map;
+                pending = false;
+                busy = true;
+                ready = false;
+                field = &fields[published == 0 ? 1 : 0];
+            }
+
+            field->build(*source, job, version, FLOW_FIELD_RANGE);
+
+            std::lock_guard<std::mutex> guard(lock);
+            busy = false;
+            ready = true;
+            idle.notify_all();
+        }
+    }
+
+public:
+    FlowFieldBuilder()
+        : published(-1), ready(false), map(NULL), mapVersion(0), pending(false), busy(false),
+          stopping(false), threaded(false) {}
+
+    ~FlowFieldBuilder() { setThreaded(false); }
+
+    // Search on a worker thread (true) or inside request() (false)
+    void setThreaded(bool enabled) {
+        if (enabled == threaded) return;
+        if (enabled) {
+            stopping = false;
+            worker = std::thread(&FlowFieldBuilder::workerLoop, this);
+        } else {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+                pending = false;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+        threaded = enabled;
+    }
+
+    bool isThreaded() const { return threaded; }
+
+    // Ask for a search from these targets. A threaded request replaces any
+    // request the worker hasn't started yet.
+    void request(const WorldMap& source, const std::vector<FlowTarget>& from, int version) {
+        if (!threaded) {
+            FlowField& field = fields[published == 0 ? 1 : 0];
+            field.build(source, from, version, FLOW_FIELD_RANGE);
+            published = published == 0 ? 1 : 0;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            map = &source;
+            targets = from;
+            mapVersion = version;
+            pending = true;
+        }
+        wake.notify_one();
+    }
+
+    // Newest finished field, or NULL if none has finished since reset()
+    const FlowField* current() {
+        if (threaded) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (ready && !busy) {
+                published = published == 0 ? 1 : 0;
+                ready = false;
+            }
+        }
+        return published >= 0 ? &fields[published] : NULL;
+    }
+
+    // Wait until no search is running or waiting to run
+    void finish() {
+        if (!threaded) return;
+        std::unique_lock<std::mutex> guard(lock);
+        idle.wait(guard, [&] { return !pending && !busy; });
+    }
+
+    // Drop the fields, after the map was replaced by one they don't fit
+    void reset() {
+        finish();
+        std::lock_guard<std::mutex> guard(lock);
+        published = -1;
+        ready = false;
+    }
+};
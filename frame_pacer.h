@@ -0,0 +1,213 @@
+#pragma once
+
+// Frame pacing and frame-time telemetry. FramePacer holds frames to a fixed
+// rate on the steady (monotonic) clock. It waits out most of a frame's slack
+// in short sleeps and spins through the rest, so a frame starts on its
+// deadline rather than wherever the OS timer next fires. It learns how long
+// a sleep really takes and stops sleeping once the time left is within that,
+// so a coarse system timer costs spinning, not missed deadlines.
+//
+// The start of every frame is stamped into a FrameTimingRing, a fixed-size
+// ring written without locks. Any thread can read percentiles of the recent
+// frame times from it while frames keep coming.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "profiler.h"
+
+const int FRAME_TIMING_CAPACITY = 4096; // Frames kept for statistics; a power of two
+
+// Frame times over the frames still in the ring, in milliseconds
+struct FrameTimingStats {
+    int frames;            // Frame times measured (one less than the frames stamped)
+    double mean, p50, p95, p99, max;
+    int missed;            // Frames among them that started after their deadline
+    long long totalMissed; // Missed deadlines since the pacer was created
+};
+
+// One writer, any number of readers. The writer never waits; a reader copies
+// the entries and then drops any the writer overwrote while it was copying,
+// as a seqlock reader would.
+class FrameTimingRing {
+private:
+    struct Entry {
+        std::atomic<long long> start; // Steady clock, nanoseconds
+        std::atomic<bool> missed;
+    };
+
+    Entry entries[FRAME_TIMING_CAPACITY];
+    std::atomic<long long> claimed;     // Entries the writer started, raised before it touches one
+    std::atomic<long long> written;     // Entries finished, raised after
+    std::atomic<long long> totalMissed;
+
+public:
+    FrameTimingRing() : claimed(0), written(0), totalMissed(0) {
+        for (Entry& entry : entries) {
+            entry.start.store(0, std::memory_order_relaxed);
+            entry.missed.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void record(std::chrono::steady_clock::time_point start, bool missed) {
+        long long n = written.load(std::memory_order_relaxed);
+        claimed.store(n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Entry& entry = entries[n & (FRAME_TIMING_CAPACITY - 1)];
+        entry.start.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(),
+                          std::memory_order_relaxed);
+        entry.missed.store(missed, std::memory_order_relaxed);
+        if (missed) totalMissed.fetch_add(1, std::memory_order_relaxed);
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    long long getFrames() const { return written.load(std::memory_order_acquire); }
+
+    // Frame start times still in the ring, oldest first, with their missed flags
+    void copy(std::vector<long long>& starts, std::vector<bool>& missed) const {
+        long long end = written.load(std::memory_order_acquire);
+        long long begin = std::max(0LL, end - FRAME_TIMING_CAPACITY);
+        starts.clear();
+        missed.clear();
+        for (long long i = begin; i < end; i++) {
+            const Entry& entry = entries[i & (FRAME_TIMING_CAPACITY - 1)];
+            starts.push_back(entry.start.load(std::memory_order_relaxed));
+            missed.push_back(entry.missed.load(std::memory_order_relaxed));
+        }
+        // Entries the writer reached while we copied may hold newer frames
+        std::atomic_thread_fence(std::memory_order_acquire);
+        long long overwritten = claimed.load(std::memory_order_relaxed) - FRAME_TIMING_CAPACITY - begin;
+        if (overwritten > 0) {
+            overwritten = std::min<long long>(overwritten, starts.size());
+            starts.erase(starts.begin(), starts.begin() + overwritten);
+            missed.erase(missed.begin(), missed.begin() + overwritten);
+        }
+    }
+
+    FrameTimingStats getStats() const {
+        std::vector<long long> starts;
+        std::vector<bool> missed;
+        copy(starts, missed);
+
+        FrameTimingStats stats;
+        stats.frames = 0;
+        stats.mean = stats.p50 = stats.p95 = stats.p99 = stats.max = 0;
+        stats.missed = 0;
+        stats.totalMissed = totalMissed.load(std::memory_order_relaxed);
+
+        std::vector<double> times;
+        for (size_t i = 1; i < starts.size(); i++) {
+            times.push_back((starts[i] - starts[i - 1]) * 1e-6);
+            if (missed[i]) stats.missed++;
+        }
+        if (times.empty()) return stats;
+
+        double sum = 0;
+        for (double t : times) sum += t;
+        std::sort(times.begin(), times.end());
+        // Nearest rank: the smallest time at least p of the frames don't exceed
+        auto percentile = [&](double p) { return times[std::max(0, int(std::ceil(p * times.size())) - 1)]; };
+        stats.frames = int(times.size());
+        stats.mean = sum / times.size();
+        stats.p50 = percentile(0.50);
+        stats.p95 = percentile(0.95);
+        stats.p99 = percentile(0.99);
+        stats.max = times.back();
+        return stats;
+    }
+};
+
+class FramePacer {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration period;    // Zero: don't wait, only stamp frames
+    Clock::time_point deadline; // When the next frame is due
+    bool started;
+
+    // How long sleep_for(SLEEP_STEP) really takes, in seconds (Welford mean and variance)
+    double sleepMean, sleepM2;
+    long long sleepCount;
+
+    FrameTimingRing timings;
+
+    static constexpr std::chrono::microseconds SLEEP_STEP{1000};
+
+    // Sleeps longer than this can't be relied on to wake in time: the mean plus one standard deviation
+    double sleepEstimate() const {
+        if (sleepCount < 2) return sleepMean;
+        return sleepMean + std::sqrt(sleepM2 / (sleepCount - 1));
+    }
+
+    void observeSleep(double seconds) {
+        sleepCount++;
+        double delta = seconds - sleepMean;
+        sleepMean += delta / sleepCount;
+        sleepM2 += delta * (seconds - sleepMean);
+    }
+
+    // Sleep while the time left clearly exceeds what a sleep may overshoot by, then spin
+    void waitUntil(Clock::time_point until) {
+        Clock::time_point now = Clock::now();
+        while (std::chrono::duration<double>(until - now).count() > sleepEstimate()) {
+            std::this_thread::sleep_for(SLEEP_STEP);
+            Clock::time_point woke = Clock::now();
+            observeSleep(std::chrono::duration<double>(woke - now).count());
+            now = woke;
+        }
+        while (Clock::now() < until) {
+            std::this_thread::yield();
+        }
+    }
+
+public:
+    FramePacer(double rate = 0) : started(false), sleepMean(0.002), sleepM2(0), sleepCount(0) {
+        setRate(rate);
+    }
+
+    // Frames per second to hold to; 0 stamps frames without waiting
+    void setRate(double rate) {
+        period = rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate))
+                          : Clock::duration::zero();
+        started = false;
+    }
+
+    double getRate() const {
+        return period > Clock::duration::zero() ? 1.0 / std::chrono::duration<double>(period).count() : 0;
+    }
+
+    // Call between frames: wait until the next frame is due and stamp its start.
+    // Returns false if the deadline had already passed. A late frame starts at
+    // once and the schedule moves with it, so one slow frame isn't followed by
+    // a burst of short ones.
+    bool waitForNextFrame() {
+        PROFILE_SCOPE("pace");
+        Clock::time_point now = Clock::now();
+        bool late = false;
+        if (!started) {
+            started = true;
+            deadline = now;
+        } else if (period > Clock::duration::zero()) {
+            late = now > deadline;
+            if (late) {
+                deadline = now;
+            } else {
+                waitUntil(deadline);
+                now = Clock::now();
+            }
+        }
+        timings.record(now, late);
+        deadline += period;
+        return !late;
+    }
+
+    const FrameTimingRing& getTimings() const { return timings; }
+
+    FrameTimingStats getStats() const { return timings.getStats(); }
+
+    // Sleep overshoot the pacer plans for, in milliseconds
+    double getSleepEstimate() const { return sleepEstimate() * 1000.0; }
+};
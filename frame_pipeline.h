@@ -0,0 +1,218 @@
+#pragma once
+
+// Pipelined frame loop: simulate, render and present run as stages that
+// overlap instead of one after the other. The simulation already ticks on its
+// own thread and runs a tick ahead of what is drawn (simulation.h); this adds
+// the last stage. Frames are finished into a ring of render targets, and a
+// presenter thread hands each finished frame to a sink (a blit to the window,
+// or whatever a headless run does with it) while the next frame renders.
+//
+// The depth is the number of render targets. One target presents inline, the
+// way the loop always did. Two let frame N+1 render while frame N presents.
+// Three (the default) add a queued frame, so neither stage waits on the other
+// as long as each keeps up on average. Every target beyond one adds a frame of
+// latency in exchange for throughput on multi-core hosts. The target shown
+// last is kept until a newer frame has been presented, so it can be presented
+// again (a window repaint) at any time.
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include "engine.h"
+
+const int DEFAULT_PIPELINE_DEPTH = 3;
+const int MAX_PIPELINE_DEPTH = 8;
+
+struct FramePipelineStats {
+    long long rendered;   // Frames finished and queued
+    long long presented;  // Frames the sink was given
+    long long unchanged;  // Frames identical to the one before, never queued
+    long long stalls;     // Times the render stage waited for a free target
+};
+
+class FramePipeline {
+public:
+    // Receives each finished frame, row-major ARGB at the game's output size.
+    // The pixels stay valid until the call returns.
+    typedef std::function<void(const unsigned int* pixels)> Sink;
+
+private:
+    Game& game;
+    int depth;
+    Sink sink;
+    std::vector<unsigned int*> targets;
+    std::vector<unsigned int*> freeTargets; // Targets nobody is rendering into, presenting or showing
+    std::deque<unsigned int*> queued;       // Finished frames waiting for the presenter, oldest first
+    unsigned int* shown;                    // Target presented last, NULL before the first frame
+    bool presenting;                        // The presenter is giving a frame to the sink
+    bool running;
+    bool stopping;
+    FramePipelineStats stats;
+
+    std::thread presenter;
+    std::mutex lock;
+    std::condition_variable frameQueued;
+    std::condition_variable targetFreed;
+
+    void presentLoop() {
+        PROFILE_THREAD("presenter");
+        while (true) {
+            unsigned int* frame;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                frameQueued.wait(guard, [&] { return stopping || !queued.empty(); });
+                if (queued.empty()) return; // Stopping, and every queued frame is out
+                frame = queued.front();
+                queued.pop_front();
+                presenting = true;
+            }
+
+            {
+                PROFILE_SCOPE("sink");
+                sink(frame);
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (shown) freeTargets.push_back(shown);
+            shown = frame;
+            presenting = false;
+            stats.presented++;
+            targetFreed.notify_all();
+        }
+    }
+
+    void freeBuffers() {
+        for (unsigned int* target : targets) freeAligned(target);
+        targets.clear();
+        freeTargets.clear();
+        shown = NULL;
+    }
+
+public:
+    FramePipeline(Game& target, int frames = DEFAULT_PIPELINE_DEPTH)
+        : game(target), depth(1), shown(NULL), presenting(false), running(false), stopping(false) {
+        stats.rendered = stats.presented = stats.unchanged = stats.stalls = 0;
+        setDepth(frames);
+    }
+
+    ~FramePipeline() {
+        stop();
+        freeBuffers();
+    }
+
+    // Render targets in flight, 1 to MAX_PIPELINE_DEPTH; takes effect the next time the pipeline starts
+    void setDepth(int frames) { depth = std::max(1, std::min(frames, MAX_PIPELINE_DEPTH)); }
+
+    int getDepth() const { return depth; }
+
+    // Start presenting finished frames to presentFrame. Depth 1 presents on the
+    // render thread, inside renderFrame().
+    void start(const Sink& presentFrame) {
+        stop();
+        freeBuffers();
+        sink = presentFrame;
+        size_t pixels = size_t(game.getScreenWidth()) * game.getScreenHeight();
+        for (int i = 0; i < depth; i++) {
+            unsigned int* target = allocAligned<unsigned int>(pixels);
+            std::fill(target, target + pixels, 0u);
+            targets.push_back(target);
+        }
+        freeTargets = targets;
+        stopping = false;
+        running = true;
+        if (depth > 1) {
+            presenter = std::thread(&FramePipeline::presentLoop, this);
+        }
+    }
+
+    // Present every frame still queued, then stop the presenter. The game draws
+    // into its own buffer again.
+    void stop() {
+        if (!running) return;
+        if (presenter.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            frameQueued.notify_one();
+            presenter.join();
+        }
+        running = false;
+        game.setRenderTarget(NULL);
+    }
+
+    bool isRunning() const { return running; }
+
+    // Render stage: draw one frame with render (Game::render, or
+    // SimulationThread::render) into a free target and queue it for the
+    // presenter, waiting first if every target is busy. Frames render() reports
+    // unchanged aren't queued. Returns render()'s result.
+    bool renderFrame(const std::function<bool()>& render) {
+        if (!running) return render();
+
+        unsigned int* target;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (freeTargets.empty()) {
+                stats.stalls++;
+                targetFreed.wait(guard, [&] { return !freeTargets.empty(); });
+            }
+            target = freeTargets.back();
+            freeTargets.pop_back();
+        }
+
+        game.setRenderTarget(target);
+        bool changed = render();
+
+        // One target: present it here, and it stays both shown and free
+        if (depth == 1) {
+            if (changed) sink(target);
+            std::lock_guard<std::mutex> guard(lock);
+            if (changed) {
+                stats.rendered++;
+                stats.presented++;
+                shown = target;
+            } else {
+                stats.unchanged++;
+            }
+            freeTargets.push_back(target);
+            return changed;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (changed) {
+            queued.push_back(target);
+            stats.rendered++;
+            frameQueued.notify_one();
+        } else {
+            freeTargets.push_back(target);
+            stats.unchanged++;
+        }
+        return changed;
+    }
+
+    // Call fn with the frame presented last, if there is one, while making sure
+    // the presenter doesn't recycle it. For repainting a window between frames.
+    template <typename Fn>
+    bool withShownFrame(Fn fn) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (!shown) return false;
+        fn((const unsigned int*)shown);
+        return true;
+    }
+
+    // Wait until every queued frame has been presented
+    void flush() {
+        std::unique_lock<std::mutex> guard(lock);
+        targetFreed.wait(guard, [&] { return queued.empty() && !presenting; });
+    }
+
+    FramePipelineStats getStats() {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+};
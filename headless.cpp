@@ -0,0 +1,465 @@
+// Headless front end: runs the engine without a window and renders frames
+// back to back as fast as the CPU allows, then reports throughput.
+//
+//   headless [--frames N] [--width W] [--height H] [--static] [--ppm out.ppm]
+//            [--packet 1|4|8|16] [--threads N] [--row-major] [--distance-shading]
+//            [--palettized] [--flat-floor] [--budget MS [--budget-width-only]]
+//            [--no-frame-cache] [--turn-only] [--no-panorama] [--skip-empty]
+//            [--map file | --map-size N] [--save-map file] [--view-distance D]
+//            [--enemies N] [--no-pathfinding] [--sync-pathfinding] [--scalar-enemies]
+//            [--sim-thread [--tick-rate HZ]] [--pipeline DEPTH] [--pace HZ]
+//            [--trace out.json] [--trace-bin out.bin] [--seed N]
+//            [--record demo.bin | --replay demo.bin [--timings out.csv]]
+//
+// By default the camera walks and turns on a fixed script so every run sees
+// the same kind of workload; --static pins the camera to the spawn point and
+// --turn-only keeps it turning on the spot. --map-size generates a larger
+// random level and --save-map writes the level as a map file that --map
+// loads back. --view-distance sets how far rays search for walls before
+// drawing fog. --enemies respawns the level with N enemies. --no-pathfinding
+// sends enemies straight at the player; --sync-pathfinding searches their
+// paths inside update() so runs repeat exactly; --scalar-enemies keeps enemy
+// updates off the AVX2 kernel. --sim-thread moves update()
+// to a fixed-rate simulation thread (60 Hz, or --tick-rate) and draws each
+// frame between its snapshots, so frames run as fast as they can while the
+// game keeps its own pace. --pipeline renders into DEPTH rotating targets
+// and hands each finished frame to a presenter thread, which checksums it the
+// way a window would blit it, while the next frame renders. --pace holds
+// frames to HZ with the frame pacer instead of running flat out; either way
+// the report ends with frame time percentiles. --trace and --trace-bin dump
+// the profiler's events as Chrome trace JSON or in binary; they need a build
+// with -DENGINE_PROFILING. --seed fixes the seed the level and enemies are
+// generated from, so two runs start alike. --record saves the run as a demo:
+// the level's recipe and every update's input. --replay plays a demo back
+// flat out, update by update, checking the game's state against the one
+// recorded after each update, and --timings writes each replayed frame's
+// update and render times as CSV. Demos always play on a generated level
+// and search paths inside update(), so --map and --sim-thread don't apply to
+// a replay.
+
+#include "engine.h"
+#include "simulation.h"
+#include "frame_pipeline.h"
+#include "frame_pacer.h"
+#include "profiler.h"
+#include "demo.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// Write a row-major ARGB buffer as a binary PPM, for eyeballing headless output
+static bool writePPM(const char* path, const unsigned int* pixels, int width, int height) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    vector<unsigned char> row(width * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned int pixel = pixels[y * width + x];
+            row[x * 3 + 0] = (pixel >> 16) & 0xFF;
+            row[x * 3 + 1] = (pixel >> 8) & 0xFF;
+            row[x * 3 + 2] = pixel & 0xFF;
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    fclose(file);
+    return true;
+}
+
+// FNV-1a over a frame's pixels: stands in for the blit as the headless present stage
+static unsigned long long frameChecksum(const unsigned int* pixels, int count) {
+    unsigned long long hash = 1469598103934665603ull;
+    for (int i = 0; i < count; i++) {
+        hash = (hash ^ pixels[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Scripted input for frame i: walk forward, strafe back and forth and keep turning
+static InputState scriptedInput(int frame) {
+    InputState input;
+    input.forward = (frame / 120) % 2 == 0;
+    input.backward = !input.forward;
+    input.strafeLeft = (frame / 45) % 4 == 1;
+    input.strafeRight = (frame / 45) % 4 == 3;
+    input.turn = 0.02f;
+    return input;
+}
+
+int main(int argc, char** argv) {
+    int frames = 1000;
+    int width = SCREEN_WIDTH;
+    int height = SCREEN_HEIGHT;
+    bool staticCamera = false;
+    const char* ppmPath = NULL;
+    int packetWidth = 0;  // 0 = widest the CPU supports
+    int threads = 0;      // 0 = one per core
+    bool rowMajor = false;
+    bool distanceShading = false;
+    bool palettized = false;
+    bool flatFloor = false;
+    double budgetMs = 0;  // 0 = fixed resolution
+    bool budgetWidthOnly = false;
+    bool frameCache = true;
+    bool turnOnly = false;
+    bool panorama = true;
+    bool skipEmpty = false;
+    const char* mapPath = NULL;
+    int mapSize = 0;      // 0 = the built-in 24x24 level
+    const char* saveMapPath = NULL;
+    float viewDistance = 0; // 0 = MAX_VIEW_DISTANCE
+    int enemies = -1;       // -1 = DEFAULT_ENEMY_COUNT
+    bool pathfinding = true;
+    bool syncPathfinding = false;
+    bool scalarEnemies = false;
+    bool simThread = false;
+    int tickRate = DEFAULT_TICK_RATE;
+    int pipelineDepth = 0;  // 0 = render and present on this thread, no pipeline
+    double paceRate = 0;    // 0 = as fast as possible
+    const char* tracePath = NULL;
+    const char* traceBinPath = NULL;
+    long long seed = -1;    // -1 = seeded from the clock
+    const char* recordPath = NULL;
+    const char* replayPath = NULL;
+    const char* timingsPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--static") == 0) {
+            staticCamera = true;
+        } else if (strcmp(argv[i], "--ppm") == 0 && i + 1 < argc) {
+            ppmPath = argv[++i];
+        } else if (strcmp(argv[i], "--packet") == 0 && i + 1 < argc) {
+            packetWidth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--row-major") == 0) {
+            rowMajor = true;
+        } else if (strcmp(argv[i], "--distance-shading") == 0) {
+            distanceShading = true;
+        } else if (strcmp(argv[i], "--palettized") == 0) {
+            palettized = true;
+        } else if (strcmp(argv[i], "--flat-floor") == 0) {
+            flatFloor = true;
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            budgetMs = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--budget-width-only") == 0) {
+            budgetWidthOnly = true;
+        } else if (strcmp(argv[i], "--no-frame-cache") == 0) {
+            frameCache = false;
+        } else if (strcmp(argv[i], "--turn-only") == 0) {
+            turnOnly = true;
+        } else if (strcmp(argv[i], "--no-panorama") == 0) {
+            panorama = false;
+        } else if (strcmp(argv[i], "--skip-empty") == 0) {
+            skipEmpty = true;
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            mapPath = argv[++i];
+        } else if (strcmp(argv[i], "--map-size") == 0 && i + 1 < argc) {
+            mapSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--save-map") == 0 && i + 1 < argc) {
+            saveMapPath = argv[++i];
+        } else if (strcmp(argv[i], "--view-distance") == 0 && i + 1 < argc) {
+            viewDistance = float(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--enemies") == 0 && i + 1 < argc) {
+            enemies = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scalar-enemies") == 0) {
+            scalarEnemies = true;
+        } else if (strcmp(argv[i], "--no-pathfinding") == 0) {
+            pathfinding = false;
+        } else if (strcmp(argv[i], "--sync-pathfinding") == 0) {
+            syncPathfinding = true;
+        } else if (strcmp(argv[i], "--sim-thread") == 0) {
+            simThread = true;
+        } else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            tickRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipelineDepth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pace") == 0 && i + 1 < argc) {
+            paceRate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--trace-bin") == 0 && i + 1 < argc) {
+            traceBinPath = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoll(argv[++i], NULL, 0) & 0xFFFFFFFFLL;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc) {
+            timingsPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--frames N] [--width W] [--height H] [--static] [--ppm out.ppm] [--packet 1|4|8|16] [--threads N] [--row-major] [--distance-shading] [--palettized] [--flat-floor] [--budget MS [--budget-width-only]] [--no-frame-cache] [--turn-only] [--no-panorama] [--skip-empty] [--map file | --map-size N] [--save-map file] [--view-distance D] [--enemies N] [--no-pathfinding] [--sync-pathfinding] [--scalar-enemies] [--sim-thread [--tick-rate HZ]] [--pipeline DEPTH] [--pace HZ] [--trace out.json] [--trace-bin out.bin] [--seed N] [--record demo.bin | --replay demo.bin [--timings out.csv]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Demo demo;
+    bool replaying = replayPath != NULL;
+    if ((recordPath || replaying) && mapPath) {
+        fprintf(stderr, "demos need a generated level: drop --map\n");
+        return 1;
+    }
+    if (recordPath && staticCamera) {
+        fprintf(stderr, "--static runs no updates, so there is nothing to record\n");
+        return 1;
+    }
+    if (recordPath && replaying) {
+        fprintf(stderr, "can't record and replay at once\n");
+        return 1;
+    }
+    if (replaying) {
+        if (!demo.load(replayPath)) {
+            fprintf(stderr, "can't load demo %s\n", replayPath);
+            return 1;
+        }
+        // The demo says what happens each update; updates run on this thread
+        frames = demo.getTicks();
+        staticCamera = false;
+        simThread = false;
+    } else if (timingsPath) {
+        fprintf(stderr, "--timings needs --replay\n");
+        return 1;
+    }
+
+    if (frames <= 0 || width < 320 || height < 240) {
+        fprintf(stderr, "need at least one frame and a resolution of 320x240 or more\n");
+        return 1;
+    }
+    bool tracing = tracePath || traceBinPath;
+    if (tracing && !PROFILING_COMPILED_IN) {
+        fprintf(stderr, "built without ENGINE_PROFILING: the trace will hold no events\n");
+    }
+    PROFILE_THREAD("main");
+
+    // Owned here, ahead of the simulation thread and pipeline that use it, so
+    // they stop before it goes away on every way out of main
+    unique_ptr<Game> game(seed >= 0 ? new Game(width, height, uint32_t(seed)) : new Game(width, height));
+    // A demo's level comes from Demo::startLevel below, on the game as constructed
+    bool demoLevel = recordPath || replaying;
+    if (mapSize > 0 && !demoLevel && !game->generateMap(mapSize, mapSize)) {
+        fprintf(stderr, "can't generate a %dx%d map\n", mapSize, mapSize);
+        return 1;
+    }
+    if (mapPath) {
+        auto loadStart = chrono::steady_clock::now();
+        if (!game->loadMap(mapPath)) {
+            fprintf(stderr, "can't load map %s\n", mapPath);
+            return 1;
+        }
+        printf("mapped %dx%d level in %.3f ms\n", game->getMapWidth(), game->getMapHeight(),
+               chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count());
+    }
+    if (enemies >= 0 && !demoLevel) {
+        game->setEnemyCount(enemies);
+    }
+    if (packetWidth > 0) {
+        game->setRayPacketWidth(packetWidth);
+    }
+    if (threads > 0) {
+        game->setThreadCount(threads);
+    }
+    if (rowMajor) {
+        game->setColumnMajorTarget(false);
+    }
+    game->setDistanceShading(distanceShading);
+    game->setPalettized(palettized);
+    game->setTexturedFloor(!flatFloor);
+    game->setDynamicResolution(budgetMs, !budgetWidthOnly);
+    game->setFrameCaching(frameCache);
+    game->setPanorama(panorama);
+    game->setEmptySpaceSkipping(skipEmpty);
+    game->setPathfinding(pathfinding);
+    game->setPathfindingThreaded(!syncPathfinding);
+    game->setSimdEnemyUpdate(!scalarEnemies);
+    if (viewDistance > 0) {
+        game->setMaxViewDistance(viewDistance);
+    }
+    if (recordPath) {
+        demo.begin(game->getSeed(), mapSize > 0 ? mapSize : MAP_WIDTH, mapSize > 0 ? mapSize : MAP_HEIGHT,
+                   enemies >= 0 ? enemies : DEFAULT_ENEMY_COUNT, pathfinding);
+    }
+    if (demoLevel && !demo.startLevel(*game)) {
+        fprintf(stderr, "can't generate the demo's %dx%d level\n", demo.getMapWidth(), demo.getMapHeight());
+        return 1;
+    }
+    if (saveMapPath && !game->saveMap(saveMapPath)) {
+        fprintf(stderr, "could not write %s\n", saveMapPath);
+    }
+    if (replaying) {
+        printf("replaying %d ticks: seed %u, %dx%d level, %d enemies\n", demo.getTicks(), demo.getSeed(),
+               demo.getMapWidth(), demo.getMapHeight(), demo.getEnemyCount());
+    }
+    if (staticCamera) {
+        game->setCamera(Vec2(5.5f, 5.5f), Vec2(-1, 0), Vec2(0, 0.66f));
+    }
+
+    SimulationThread simulation(*game, tickRate);
+    if (simThread && recordPath) {
+        simulation.setRecording(&demo);
+    }
+    if (simThread) {
+        simulation.start();
+    }
+    FramePipeline pipeline(*game, pipelineDepth);
+    unsigned long long lastChecksum = 0;
+    if (pipelineDepth > 0) {
+        pipeline.start([&](const unsigned int* pixels) { lastChecksum = frameChecksum(pixels, width * height); });
+    }
+    auto renderFrame = [&]() { return simThread ? simulation.render() : game->render(); };
+
+    // Replay bookkeeping: per-frame times and the first update whose state differs
+    vector<double> updateTimes, renderTimes;
+    vector<uint64_t> stateChecksums;
+    int divergedAt = -1;
+
+    FramePacer pacer(paceRate);
+    Profiler::setEnabled(tracing);
+
+    int scaleChanges = 0;
+    int lastLevel = 0;
+    auto start = chrono::steady_clock::now();
+    pacer.waitForNextFrame();
+    for (int i = 0; i < frames; i++) {
+        if (replaying) {
+            auto updateStart = chrono::steady_clock::now();
+            game->update(demo.input(i));
+            auto renderStart = chrono::steady_clock::now();
+            if (pipelineDepth > 0) {
+                pipeline.renderFrame(renderFrame);
+            } else {
+                renderFrame();
+            }
+            auto renderEnd = chrono::steady_clock::now();
+            uint64_t state = game->stateChecksum();
+            if (divergedAt < 0 && state != demo.checksum(i)) divergedAt = i;
+            updateTimes.push_back(chrono::duration<double, milli>(renderStart - updateStart).count());
+            renderTimes.push_back(chrono::duration<double, milli>(renderEnd - renderStart).count());
+            stateChecksums.push_back(state);
+            pacer.waitForNextFrame();
+            continue;
+        }
+        if (!staticCamera) {
+            InputState input = scriptedInput(i);
+            if (turnOnly) {
+                input.forward = input.backward = input.strafeLeft = input.strafeRight = false;
+            }
+            if (simThread) {
+                simulation.postInput(input);
+            } else {
+                game->update(input);
+                if (recordPath) demo.record(input, game->stateChecksum());
+            }
+        }
+        if (pipelineDepth > 0) {
+            pipeline.renderFrame(renderFrame);
+        } else {
+            renderFrame();
+        }
+        int level = game->getResolutionController().getLevel();
+        if (level != lastLevel) scaleChanges++;
+        lastLevel = level;
+        pacer.waitForNextFrame();
+    }
+    pipeline.flush();
+    auto end = chrono::steady_clock::now();
+    simulation.stop();
+    Profiler::setEnabled(false);
+
+    double seconds = chrono::duration<double>(end - start).count();
+    printf("%d frames at %dx%d (%d-ray packets, %d threads) in %.3f s: %.1f fps, %.3f ms/frame\n",
+           frames, width, height, game->getRayPacketWidth(), game->getThreadCount(), seconds, frames / seconds, seconds * 1000.0 / frames);
+
+    if (replaying) {
+        if (divergedAt < 0) {
+            printf("replay: %d ticks, final state %016llx, matches the recording\n", frames,
+                   (unsigned long long)game->stateChecksum());
+        } else {
+            printf("replay: diverged from the recording at tick %d of %d\n", divergedAt, frames);
+        }
+    }
+    if (timingsPath) {
+        FILE* csv = fopen(timingsPath, "w");
+        bool written = csv != NULL;
+        if (csv) {
+            fprintf(csv, "frame,update_ms,render_ms,state\n");
+            for (size_t i = 0; i < updateTimes.size(); i++) {
+                fprintf(csv, "%zu,%.4f,%.4f,%016llx\n", i, updateTimes[i], renderTimes[i],
+                        (unsigned long long)stateChecksums[i]);
+            }
+            written = fclose(csv) == 0;
+        }
+        if (!written) fprintf(stderr, "could not write %s\n", timingsPath);
+    }
+    if (recordPath) {
+        if (demo.save(recordPath)) {
+            printf("recorded %d ticks to %s (seed %u)\n", demo.getTicks(), recordPath, demo.getSeed());
+        } else {
+            fprintf(stderr, "could not write %s\n", recordPath);
+        }
+    }
+
+    if (simThread) {
+        printf("simulation: %lld ticks at %d Hz alongside %d frames\n", simulation.getTicks(), tickRate, frames);
+    }
+
+    if (pipelineDepth > 0) {
+        FramePipelineStats pipelineStats = pipeline.getStats();
+        printf("pipeline: depth %d, %lld frames presented, %lld unchanged, %lld stalls, last frame %016llx\n",
+               pipeline.getDepth(), pipelineStats.presented, pipelineStats.unchanged, pipelineStats.stalls, lastChecksum);
+    }
+
+    FrameTimingStats timing = pacer.getStats();
+    printf("frame times over the last %d frames: mean %.3f ms, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f ms",
+           timing.frames, timing.mean, timing.p50, timing.p95, timing.p99, timing.max);
+    if (paceRate > 0) {
+        printf(", %lld missed deadlines at %.1f Hz", timing.totalMissed, paceRate);
+    }
+    printf("\n");
+
+    ScalerCacheStats scalers = game->getScalerCacheStats();
+    printf("column scalers: %lld hits, %lld built, %lld fixed-point fallbacks, %zu of %zu bytes\n",
+           scalers.hits, scalers.builds, scalers.fallbacks, scalers.bytes, scalers.budget);
+
+    FrameCacheStats frameStats = game->getFrameCacheStats();
+    printf("frame cache: %lld full, %lld partial, %lld unchanged frames\n",
+           frameStats.full, frameStats.partial, frameStats.skipped);
+
+    PanoramaStats panoramaStats = game->getPanoramaStats();
+    printf("panorama: %lld sectors traced, %lld rays resolved, %lld rays traced at face edges\n",
+           panoramaStats.sectors, panoramaStats.resolved, panoramaStats.traced);
+
+    if (budgetMs > 0) {
+        printf("dynamic resolution: %.2f ms budget, last scene %.3f ms, view %dx%d, %d scale changes\n",
+               budgetMs, game->getSceneTime(), game->getViewWidth(), game->getViewHeight(), scaleChanges);
+    }
+
+    if (ppmPath) {
+        // A pipelined run's last frame is in the target presented last
+        bool written = false;
+        if (pipelineDepth > 0) {
+            pipeline.withShownFrame([&](const unsigned int* pixels) { written = writePPM(ppmPath, pixels, width, height); });
+        } else {
+            written = writePPM(ppmPath, game->getRenderBuffer(), width, height);
+        }
+        if (!written) fprintf(stderr, "could not write %s\n", ppmPath);
+    }
+
+    if (tracePath && !Profiler::writeChromeTrace(tracePath)) {
+        fprintf(stderr, "could not write %s\n", tracePath);
+    }
+    if (traceBinPath && !Profiler::writeBinary(traceBinPath)) {
+        fprintf(stderr, "could not write %s\n", traceBinPath);
+    }
+    if (tracing) {
+        printf("profiler: %lld events recorded\n", Profiler::getEventCount());
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// Min-mip occupancy pyramid for empty-space skipping. Level 0 marks every
+// solid map cell; each cell of level L covers a 2x2 block of level L - 1 and
+// is solid if any of them is. A ray in an empty cell looks up the largest
+// empty block around it and leaps straight to that block's far edge, so a
+// corridor n cells long costs O(log n) steps instead of n. Changing one map
+// cell only touches its ancestors, one per level.
+
+#include <vector>
+#include <cstdint>
+#include "world_map.h"
+
+class OccupancyPyramid {
+private:
+    int mapWidth, mapHeight;
+    int levels;
+    std::vector<int> size;                    // Cells per side of each level (square, power of two)
+    std::vector<std::vector<uint8_t> > cells; // cells[L][x * size[L] + y], nonzero = solid somewhere inside
+
+public:
+    OccupancyPyramid() : mapWidth(0), mapHeight(0), levels(0) {}
+
+    // Build every level from the map. The pyramid is padded to a power of two;
+    // padding counts as solid so no leap leaves the map. Reads every cell.
+    void build(const WorldMap& map) {
+        mapWidth = map.getWidth();
+        mapHeight = map.getHeight();
+        int side = 1;
+        while (side < mapWidth || side < mapHeight) side *= 2;
+
+        levels = 0;
+        size.clear();
+        cells.clear();
+        for (int s = side; s >= 1; s /= 2) {
+            size.push_back(s);
+            cells.push_back(std::vector<uint8_t>(size_t(s) * s, 1));
+            levels++;
+        }
+
+        for (int x = 0; x < mapWidth; x++) {
+            for (int y = 0; y < mapHeight; y++) {
+                cells[0][size_t(x) * side + y] = map.solid(x, y);
+            }
+        }
+        for (int level = 1; level < levels; level++) {
+            for (int x = 0; x < size[level]; x++) {
+                for (int y = 0; y < size[level]; y++) {
+                    cells[level][size_t(x) * size[level] + y] = merged(level, x, y);
+                }
+            }
+        }
+    }
+
+    // A level-L cell is solid if any of the 2x2 cells below it is
+    uint8_t merged(int level, int x, int y) const {
+        const std::vector<uint8_t>& below = cells[level - 1];
+        size_t s = size[level - 1];
+        return below[(2 * x) * s + 2 * y] | below[(2 * x) * s + 2 * y + 1] |
+               below[(2 * x + 1) * s + 2 * y] | below[(2 * x + 1) * s + 2 * y + 1];
+    }
+
+    // Record a change to one map cell, updating its ancestors until one doesn't change
+    void set(int x, int y, bool solid) {
+        if (x < 0 || y < 0 || x >= mapWidth || y >= mapHeight) return;
+        cells[0][size_t(x) * size[0] + y] = solid;
+        for (int level = 1; level < levels; level++) {
+            x /= 2;
+            y /= 2;
+            uint8_t value = merged(level, x, y);
+            uint8_t& cell = cells[level][size_t(x) * size[level] + y];
+            if (cell == value) break;
+            cell = value;
+        }
+    }
+
+    // Largest level whose block around map cell (x, y) is empty, or -1 if the
+    // cell itself is solid or outside the map
+    int emptyLevel(int x, int y) const {
+        if (x < 0 || y < 0 || x >= mapWidth || y >= mapHeight || cells[0][size_t(x) * size[0] + y]) return -1;
+        int level = 0;
+        while (level + 1 < levels) {
+            int shift = level + 1;
+            if (cells[shift][size_t(x >> shift) * size[shift] + (y >> shift)]) break;
+            level++;
+        }
+        return level;
+    }
+
+    int getLevels() const { return levels; }
+};
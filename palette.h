@@ -0,0 +1,112 @@
+#pragma once
+
+// Indexed colour for the 8-bit render path, in the style of Doom's PLAYPAL:
+// a 256-entry ARGB palette that textures and the 3D view index into, and the
+// pass that expands 8-bit pixels back to ARGB for the blit.
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PALETTE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Index 0 is fully transparent; any colour with zero alpha maps to it
+const uint8_t PALETTE_TRANSPARENT = 0;
+
+class Palette {
+private:
+    unsigned int entries[256];
+    int count;
+    std::unordered_map<unsigned int, uint8_t> lookup;
+
+    // Closest entry by squared ARGB distance, for colours that didn't fit
+    uint8_t nearest(unsigned int color) const {
+        int best = 1;
+        long long bestDistance = -1;
+        for (int i = 1; i < count; i++) {
+            long long distance = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                long long d = int((color >> shift) & 0xFF) - int((entries[i] >> shift) & 0xFF);
+                distance += d * d;
+            }
+            if (bestDistance < 0 || distance < bestDistance) {
+                best = i;
+                bestDistance = distance;
+            }
+        }
+        return uint8_t(best);
+    }
+
+public:
+    Palette() : count(1) {
+        for (int i = 0; i < 256; i++) entries[i] = 0;
+        lookup[0] = PALETTE_TRANSPARENT;
+    }
+
+    // Fill the palette with the distinct colours of `colors`, in order of first
+    // appearance. Past 256 entries, the remaining colours map to their nearest match,
+    // so callers should list the colours that matter most first.
+    void build(const std::vector<unsigned int>& colors) {
+        count = 1;
+        for (int i = 1; i < 256; i++) entries[i] = 0;
+        lookup.clear();
+        lookup[0] = PALETTE_TRANSPARENT;
+        for (unsigned int color : colors) {
+            if ((color >> 24) == 0 || lookup.count(color) || count == 256) continue;
+            entries[count] = color;
+            lookup[color] = uint8_t(count);
+            count++;
+        }
+    }
+
+    // Palette index for an ARGB colour: exact if it is in the palette, nearest otherwise
+    uint8_t find(unsigned int color) const {
+        if ((color >> 24) == 0) return PALETTE_TRANSPARENT;
+        auto it = lookup.find(color);
+        return it != lookup.end() ? it->second : nearest(color);
+    }
+
+    unsigned int color(int index) const { return entries[index]; }
+    const unsigned int* colors() const { return entries; }
+    int size() const { return count; }
+};
+
+#ifdef PALETTE_X86_SIMD
+// Eight pixels per step: widen the indices to 32 bits and gather their colours
+__attribute__((target("avx2")))
+inline void expandPixelsAVX2(const uint8_t* src, unsigned int* dst, int count, const unsigned int* palette) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        __m256i pixels = _mm256_i32gather_epi32((const int*)palette, indices, 4);
+        _mm256_storeu_si256((__m256i*)(dst + i), pixels);
+    }
+    for (; i < count; i++) {
+        dst[i] = palette[src[i]];
+    }
+}
+#endif
+
+// Expand count 8-bit pixels to ARGB through palette (256 entries)
+inline void expandPixels(const uint8_t* src, unsigned int* dst, int count, const unsigned int* palette) {
+#ifdef PALETTE_X86_SIMD
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (hasAVX2) {
+        expandPixelsAVX2(src, dst, count, palette);
+        return;
+    }
+#endif
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        dst[i] = palette[src[i]];
+        dst[i + 1] = palette[src[i + 1]];
+        dst[i + 2] = palette[src[i + 2]];
+        dst[i + 3] = palette[src[i + 3]];
+    }
+    for (; i < count; i++) {
+        dst[i] = palette[src[i]];
+    }
+}
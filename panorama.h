@@ -0,0 +1,149 @@
+#pragma once
+
+// Rotation-only fast path. While the player stands still, every wall hit the
+// camera can see lies on a 360-degree panorama traced once around its
+// position. The panorama holds the hit face (side and cell) of evenly spaced
+// directions. A column's ray falls between two samples; if both hit the same
+// wall face, the ray hits it too, and its distance follows from the face's
+// plane with the correct perspective, no DDA needed. Rays between samples on
+// different faces (corners, edges) are traced as usual. Sectors of the
+// panorama are traced lazily, the first time the view turns into them, so a
+// new position only pays for what the player actually looks at.
+
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#include "raycast.h"
+
+const int PANORAMA_SECTOR = 64; // Samples traced together when the view first turns into them
+
+// Counters for judging the fast path
+struct PanoramaStats {
+    long long sectors;   // Sectors traced
+    long long resolved;  // Rays taken from the panorama
+    long long traced;    // Rays between samples on different faces, traced with DDA
+};
+
+class Panorama {
+private:
+    int samples;
+    RayHits hits;                  // One unit-direction ray per sample
+    std::vector<int> sectorEpoch;  // Sector is traced if its entry equals epoch
+    int epoch;
+    float posX, posY;              // Position the panorama was traced from
+    int mapVersion;
+    float maxDistance;             // View distance it was traced with
+    std::vector<int> raySample;    // Sample at or just before each column's ray, this frame
+    std::vector<int> missing;      // Sectors this frame needs that aren't traced
+    long long sectorsTraced;
+    std::atomic<long long> resolved, traced;
+
+    int sectorCount() const { return (samples + PANORAMA_SECTOR - 1) / PANORAMA_SECTOR; }
+
+public:
+    Panorama() : samples(0), epoch(0), posX(0), posY(0), mapVersion(-1), maxDistance(0),
+                 sectorsTraced(0), resolved(0), traced(0) {}
+
+    // Space the samples evenly around the circle; drops everything traced
+    void resize(int count) {
+        if (count == samples) return;
+        samples = count;
+        hits.resize(samples);
+        for (int k = 0; k < samples; k++) {
+            double angle = 2.0 * M_PI * k / samples;
+            hits.rayDirX[k] = float(cos(angle));
+            hits.rayDirY[k] = float(sin(angle));
+        }
+        sectorEpoch.assign(sectorCount(), -1);
+        epoch++;
+    }
+
+    // Start over from a new position, map or view distance. Sectors are retraced on demand.
+    void moveTo(float x, float y, int version, float distance) {
+        if (x == posX && y == posY && version == mapVersion && distance == maxDistance) return;
+        posX = x;
+        posY = y;
+        mapVersion = version;
+        maxDistance = distance;
+        epoch++;
+    }
+
+    // Find the samples around each of the first `count` rays and list the
+    // sectors they fall in that still need tracing. Returns that count.
+    int prepare(const RayHits& rays, int count) {
+        raySample.resize(count);
+        missing.clear();
+        float scale = float(samples / (2.0 * M_PI));
+        for (int x = 0; x < count; x++) {
+            float angle = atan2f(rays.rayDirY[x], rays.rayDirX[x]);
+            if (angle < 0) angle += float(2.0 * M_PI);
+            int k = int(angle * scale);
+            if (k >= samples) k -= samples;
+            raySample[x] = k;
+            for (int s : { k / PANORAMA_SECTOR, (k + 1) % samples / PANORAMA_SECTOR }) {
+                if (sectorEpoch[s] != epoch) {
+                    sectorEpoch[s] = epoch;
+                    missing.push_back(s);
+                }
+            }
+        }
+        sectorsTraced += missing.size();
+        return int(missing.size());
+    }
+
+    // Trace the i-th missing sector found by prepare(). Safe to call for
+    // different sectors from different threads.
+    void traceMissing(const RayCastParams& p, int i, int packetWidth) {
+        int begin = missing[i] * PANORAMA_SECTOR;
+        castRays(p, hits, begin, std::min(begin + PANORAMA_SECTOR, samples), packetWidth);
+    }
+
+    // Fill columns [begin, end) of rays from the panorama, tracing those whose
+    // samples disagree or found nothing. A sample that missed says little about
+    // a camera ray, which is longer than the unit sample directions and so
+    // reaches further for the same perpendicular distance. Only valid after
+    // prepare() and the missing sectors.
+    void resolve(const RayCastParams& p, RayHits& rays, int begin, int end) {
+        long long edges = 0;
+        for (int x = begin; x < end; x++) {
+            int k0 = raySample[x];
+            int k1 = k0 + 1 < samples ? k0 + 1 : 0;
+            int side = hits.side[k0];
+            if (side == RAY_MISS || side != hits.side[k1] || hits.mapX[k0] != hits.mapX[k1] || hits.mapY[k0] != hits.mapY[k1]) {
+                castRays(p, rays, x, x + 1, 1);
+                edges++;
+                continue;
+            }
+
+            // Distance along the ray to the face's plane. The face is the near side
+            // of the cell, so the plane is the cell edge facing the camera.
+            int mapX = hits.mapX[k0], mapY = hits.mapY[k0];
+            if (side == 0) {
+                float rayDirX = rays.rayDirX[x];
+                float planeX = float(rayDirX < 0 ? mapX + 1 : mapX);
+                rays.perpWallDist[x] = (planeX - p.posX) / rayDirX;
+            } else {
+                float rayDirY = rays.rayDirY[x];
+                float planeY = float(rayDirY < 0 ? mapY + 1 : mapY);
+                rays.perpWallDist[x] = (planeY - p.posY) / rayDirY;
+            }
+            rays.side[x] = side;
+            rays.mapX[x] = mapX;
+            rays.mapY[x] = mapY;
+        }
+        resolved.fetch_add(end - begin - edges, std::memory_order_relaxed);
+        traced.fetch_add(edges, std::memory_order_relaxed);
+    }
+
+    PanoramaStats stats() const {
+        PanoramaStats result;
+        result.sectors = sectorsTraced;
+        result.resolved = resolved.load();
+        result.traced = traced.load();
+        return result;
+    }
+};
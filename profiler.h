@@ -0,0 +1,261 @@
+#pragma once
+
+// Scoped timers for seeing where a frame's time goes. PROFILE_SCOPE("name")
+// times the rest of the enclosing block and records it as an event on the
+// calling thread; PROFILE_THREAD("name") labels the calling thread in dumps.
+// Each thread records into a ring of its own, so recording takes no locks
+// and never waits on another thread, and a long run keeps its newest events.
+//
+// The macros compile to nothing unless ENGINE_PROFILING is defined, so a
+// normal build carries no trace of them. With it defined, recording still
+// has to be switched on with Profiler::setEnabled(true); until then a scope
+// costs one relaxed load and a branch.
+//
+// Events can be dumped as Chrome trace JSON (chrome://tracing, Perfetto) or
+// in a compact binary form. Dump while the instrumented threads are idle,
+// after a run or between frames, as the rings are read without locks.
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+const int PROFILE_RING_CAPACITY = 1 << 16; // Events kept per thread; a power of two
+const char PROFILE_FILE_MAGIC[8] = { 'R', 'C', 'P', 'R', 'O', 'F', '0', '1' };
+
+#ifdef ENGINE_PROFILING
+const bool PROFILING_COMPILED_IN = true;
+#else
+const bool PROFILING_COMPILED_IN = false;
+#endif
+
+struct ProfileEvent {
+    const char* name;     // A string literal
+    long long start, end; // Nanoseconds since the profiler started
+};
+
+// Binary dump layout: a ProfileFileHeader, then nameCount names, then
+// threadCount threads. A name or thread label is a uint32_t length and its
+// bytes. A thread is its uint32_t id, its label, a uint32_t event count and
+// that many ProfileFileEvents, oldest first. All little-endian.
+struct ProfileFileHeader {
+    char magic[8];
+    uint32_t nameCount;
+    uint32_t threadCount;
+};
+
+struct ProfileFileEvent {
+    uint64_t start;     // Nanoseconds since the profiler started
+    uint32_t duration;  // Nanoseconds, saturated at about 4.3 s
+    uint32_t name;      // Index into the name table
+};
+
+class Profiler {
+private:
+    struct ThreadLog {
+        int id;
+        std::string name;
+        std::vector<ProfileEvent> events;
+        std::atomic<long long> written; // Events ever recorded; the newest PROFILE_RING_CAPACITY are kept
+
+        explicit ThreadLog(int threadId) : id(threadId), events(PROFILE_RING_CAPACITY), written(0) {}
+    };
+
+    struct State {
+        std::atomic<bool> enabled;
+        std::chrono::steady_clock::time_point epoch;
+        std::mutex lock;                             // Guards threads
+        std::vector<std::unique_ptr<ThreadLog>> threads; // Kept after their thread exits, for dumping
+
+        State() : enabled(false), epoch(std::chrono::steady_clock::now()) {}
+    };
+
+    static State& state() {
+        static State instance;
+        return instance;
+    }
+
+    // The calling thread's log, registered on first use
+    static ThreadLog& threadLog() {
+        thread_local ThreadLog* log = NULL;
+        if (!log) {
+            State& s = state();
+            std::lock_guard<std::mutex> guard(s.lock);
+            s.threads.push_back(std::unique_ptr<ThreadLog>(new ThreadLog(int(s.threads.size()))));
+            log = s.threads.back().get();
+        }
+        return *log;
+    }
+
+    // Events still in a log, oldest first
+    static void copyEvents(const ThreadLog& log, std::vector<ProfileEvent>& out) {
+        long long end = log.written.load(std::memory_order_acquire);
+        long long begin = end > PROFILE_RING_CAPACITY ? end - PROFILE_RING_CAPACITY : 0;
+        out.clear();
+        for (long long i = begin; i < end; i++) out.push_back(log.events[i & (PROFILE_RING_CAPACITY - 1)]);
+    }
+
+    static void writeEscaped(FILE* file, const char* text) {
+        for (; *text; text++) {
+            if (*text == '"' || *text == '\\') fputc('\\', file);
+            fputc(*text, file);
+        }
+    }
+
+    static bool writeString(FILE* file, const std::string& text) {
+        uint32_t length = uint32_t(text.size());
+        return fwrite(&length, sizeof(length), 1, file) == 1 && fwrite(text.data(), 1, text.size(), file) == text.size();
+    }
+
+public:
+    static void setEnabled(bool enabled) { state().enabled.store(enabled, std::memory_order_relaxed); }
+    static bool isEnabled() { return state().enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since the profiler started
+    static long long now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state().epoch).count();
+    }
+
+    // Label the calling thread in dumps
+    static void setThreadName(const std::string& name) {
+        ThreadLog& log = threadLog();
+        std::lock_guard<std::mutex> guard(state().lock);
+        log.name = name;
+    }
+
+    static void record(const char* name, long long start, long long end) {
+        ThreadLog& log = threadLog();
+        long long n = log.written.load(std::memory_order_relaxed);
+        ProfileEvent& event = log.events[n & (PROFILE_RING_CAPACITY - 1)];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        log.written.store(n + 1, std::memory_order_release);
+    }
+
+    // Events recorded on every thread, including ones overwritten since
+    static long long getEventCount() {
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        long long count = 0;
+        for (auto& log : s.threads) count += log->written.load(std::memory_order_acquire);
+        return count;
+    }
+
+    // Drop every recorded event; thread labels stay
+    static void clear() {
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        for (auto& log : s.threads) log->written.store(0, std::memory_order_release);
+    }
+
+    // Write the events as Chrome trace JSON: one complete ("X") event per scope,
+    // in microseconds, with a thread_name record per labelled thread
+    static bool writeChromeTrace(const char* path) {
+        FILE* file = fopen(path, "w");
+        if (!file) return false;
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        std::vector<ProfileEvent> events;
+        bool first = true;
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (auto& log : s.threads) {
+            if (!log->name.empty()) {
+                fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",", log->id);
+                writeEscaped(file, log->name.c_str());
+                fprintf(file, "\"}}");
+                first = false;
+            }
+            copyEvents(*log, events);
+            for (const ProfileEvent& event : events) {
+                fprintf(file, "%s\n{\"name\":\"", first ? "" : ",");
+                writeEscaped(file, event.name);
+                fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        log->id, event.start / 1000.0, (event.end - event.start) / 1000.0);
+                first = false;
+            }
+        }
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+
+    // Write the events in the binary layout described at ProfileFileHeader
+    static bool writeBinary(const char* path) {
+        FILE* file = fopen(path, "wb");
+        if (!file) return false;
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+
+        // Copy every log first to build the name table; names are matched by text
+        std::vector<std::vector<ProfileEvent>> logs(s.threads.size());
+        std::map<std::string, uint32_t> nameIndex;
+        std::vector<std::string> names;
+        for (size_t t = 0; t < s.threads.size(); t++) {
+            copyEvents(*s.threads[t], logs[t]);
+            for (const ProfileEvent& event : logs[t]) {
+                if (nameIndex.insert(std::make_pair(std::string(event.name), uint32_t(names.size()))).second) {
+                    names.push_back(event.name);
+                }
+            }
+        }
+
+        ProfileFileHeader header;
+        memcpy(header.magic, PROFILE_FILE_MAGIC, sizeof(PROFILE_FILE_MAGIC));
+        header.nameCount = uint32_t(names.size());
+        header.threadCount = uint32_t(s.threads.size());
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (const std::string& name : names) ok = ok && writeString(file, name);
+        std::vector<ProfileFileEvent> packed;
+        for (size_t t = 0; t < s.threads.size() && ok; t++) {
+            packed.clear();
+            for (const ProfileEvent& event : logs[t]) {
+                ProfileFileEvent out;
+                out.start = uint64_t(event.start);
+                out.duration = uint32_t(std::min<long long>(event.end - event.start, UINT32_MAX));
+                out.name = nameIndex[event.name];
+                packed.push_back(out);
+            }
+            uint32_t id = uint32_t(s.threads[t]->id);
+            uint32_t count = uint32_t(packed.size());
+            ok = fwrite(&id, sizeof(id), 1, file) == 1 && writeString(file, s.threads[t]->name) &&
+                 fwrite(&count, sizeof(count), 1, file) == 1 &&
+                 fwrite(packed.data(), sizeof(ProfileFileEvent), packed.size(), file) == packed.size();
+        }
+        return fclose(file) == 0 && ok;
+    }
+};
+
+// Times its own lifetime and records it if profiling was on when it started
+class ProfileScope {
+private:
+    const char* name;
+    long long start;
+
+public:
+    explicit ProfileScope(const char* scopeName) : name(scopeName), start(-1) {
+        if (Profiler::isEnabled()) start = Profiler::now();
+    }
+
+    ~ProfileScope() {
+        if (start >= 0) Profiler::record(name, start, Profiler::now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#ifdef ENGINE_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
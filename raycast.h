@@ -0,0 +1,581 @@
+#pragma once
+
+// Wall casting kernels. Each column's ray is traced through the map with DDA,
+// either one ray at a time or as packets of 4/8/16 adjacent rays in SSE/AVX2/
+// AVX-512 lanes. Every kernel performs the same float operations in the same
+// order as the scalar one, so all of them produce bit-identical hits.
+//
+// The map's solid border (world_map.h) stops every ray that starts inside the
+// map, so a step is one bit test with no bounds checks. Rays are also cut off
+// at a maximum distance: each gets a budget of the cell steps it can take
+// before passing it, and a ray that spends the budget without a hit is a miss
+// (side RAY_MISS), drawn as fog.
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "world_map.h"
+#include "occupancy.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAYCAST_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Smallest empty block worth leaping across: 4x4 cells. Below that the
+// pyramid lookup costs more than the steps it saves.
+const int EMPTY_SKIP_MIN_LEVEL = 2;
+
+// Side of a ray that found no wall within the maximum distance
+const int RAY_MISS = -1;
+
+// Map and camera origin shared by every ray of a frame
+struct RayCastParams {
+    float posX, posY;
+    const uint32_t* solid; // Occupancy bits, cell (x, y) at bit mapCellBit(x, y, mapChunksY)
+    int mapWidth, mapHeight;
+    int mapChunksY;
+    const OccupancyPyramid* pyramid; // Empty-space skipping, or NULL for plain DDA
+    float maxDistance;               // Perpendicular distance past which rays miss
+};
+
+// Per-column rays and wall hits for one frame. Structure-of-arrays so the
+// packet kernels can load and store whole lanes at once.
+struct RayHits {
+    std::vector<float> rayDirX, rayDirY;  // Filled in before casting
+    std::vector<float> perpWallDist;      // Distance before the near-plane clamp
+    std::vector<int> side;                // 0 = x side (EW) hit, 1 = y side (NS) hit, RAY_MISS
+    std::vector<int> mapX, mapY;          // Cell that was hit, or where a miss gave up
+
+    void resize(int columns) {
+        rayDirX.resize(columns);
+        rayDirY.resize(columns);
+        perpWallDist.resize(columns);
+        side.resize(columns);
+        mapX.resize(columns);
+        mapY.resize(columns);
+    }
+};
+
+// Steps a ray takes along one axis before passing maxDistance: the cell edges
+// it crosses at sideDist, sideDist + deltaDist, ... up to maxDistance
+inline int stepBudget(float sideDist, float deltaDist, float maxDistance) {
+    return sideDist <= maxDistance ? int((maxDistance - sideDist) / deltaDist) + 1 : 0;
+}
+
+// Record a miss for column x, which gave up in cell (mapX, mapY)
+inline void storeMiss(const RayCastParams& p, RayHits& hits, int x, int mapX, int mapY) {
+    hits.perpWallDist[x] = p.maxDistance;
+    hits.side[x] = RAY_MISS;
+    hits.mapX[x] = mapX;
+    hits.mapY[x] = mapY;
+}
+
+// Trace the ray of column x one cell at a time
+inline void castRayScalar(const RayCastParams& p, RayHits& hits, int x) {
+    float rayDirX = hits.rayDirX[x];
+    float rayDirY = hits.rayDirY[x];
+
+    // Current map position
+    int mapX = int(p.posX);
+    int mapY = int(p.posY);
+
+    // Length of ray from one side to next in map
+    float deltaDistX = (rayDirX == 0) ? 1e30f : std::abs(1.0f / rayDirX);
+    float deltaDistY = (rayDirY == 0) ? 1e30f : std::abs(1.0f / rayDirY);
+
+    // Direction to step in and length of ray from current position to next x or y-side
+    int stepX, stepY;
+    float sideDistX, sideDistY;
+    if (rayDirX < 0) {
+        stepX = -1;
+        sideDistX = (p.posX - mapX) * deltaDistX;
+    } else {
+        stepX = 1;
+        sideDistX = (mapX + 1.0f - p.posX) * deltaDistX;
+    }
+    if (rayDirY < 0) {
+        stepY = -1;
+        sideDistY = (p.posY - mapY) * deltaDistY;
+    } else {
+        stepY = 1;
+        sideDistY = (mapY + 1.0f - p.posY) * deltaDistY;
+    }
+
+    // DDA algorithm, for as many steps as the distance budget allows
+    int steps = stepBudget(sideDistX, deltaDistX, p.maxDistance) + stepBudget(sideDistY, deltaDistY, p.maxDistance);
+    int hit = 0;  // Wall hit?
+    int side = 0; // NS or EW wall hit?
+
+    for (; steps > 0; steps--) {
+        // Jump to next map square
+        if (sideDistX < sideDistY) {
+            sideDistX += deltaDistX;
+            mapX += stepX;
+            side = 0;
+        } else {
+            sideDistY += deltaDistY;
+            mapY += stepY;
+            side = 1;
+        }
+
+        // Check if ray hit a wall
+        if (mapSolid(p.solid, mapX, mapY, p.mapChunksY)) {
+            hit = 1;
+            break;
+        }
+    }
+
+    if (!hit) {
+        storeMiss(p, hits, x, mapX, mapY);
+        return;
+    }
+    hits.perpWallDist[x] = (side == 0) ? sideDistX - deltaDistX : sideDistY - deltaDistY;
+    hits.side[x] = side;
+    hits.mapX[x] = mapX;
+    hits.mapY[x] = mapY;
+}
+
+// Trace the ray of column x like castRayScalar, but leap across empty blocks of
+// the occupancy pyramid instead of stepping through them cell by cell. A leap
+// puts the DDA in the last cell the ray visits inside the block, with the same
+// side distances single steps would have reached (up to float rounding), so
+// the ordinary step that follows crosses the block edge.
+inline void castRayHierarchical(const RayCastParams& p, RayHits& hits, int x) {
+    float rayDirX = hits.rayDirX[x];
+    float rayDirY = hits.rayDirY[x];
+    const OccupancyPyramid& pyramid = *p.pyramid;
+
+    int mapX = int(p.posX);
+    int mapY = int(p.posY);
+
+    float deltaDistX = (rayDirX == 0) ? 1e30f : std::abs(1.0f / rayDirX);
+    float deltaDistY = (rayDirY == 0) ? 1e30f : std::abs(1.0f / rayDirY);
+
+    int stepX, stepY;
+    float sideDistX, sideDistY;
+    if (rayDirX < 0) {
+        stepX = -1;
+        sideDistX = (p.posX - mapX) * deltaDistX;
+    } else {
+        stepX = 1;
+        sideDistX = (mapX + 1.0f - p.posX) * deltaDistX;
+    }
+    if (rayDirY < 0) {
+        stepY = -1;
+        sideDistY = (p.posY - mapY) * deltaDistY;
+    } else {
+        stepY = 1;
+        sideDistY = (mapY + 1.0f - p.posY) * deltaDistY;
+    }
+
+    int side = 0;
+    while (true) {
+        int level = pyramid.emptyLevel(mapX, mapY);
+        if (level >= EMPTY_SKIP_MIN_LEVEL) {
+            // Cells left to cross on each axis before the block edge, and when
+            // the ray would cross out through that edge
+            int blockSize = 1 << level;
+            int blockX = mapX & ~(blockSize - 1), blockY = mapY & ~(blockSize - 1);
+            int cellsX = stepX > 0 ? blockX + blockSize - 1 - mapX : mapX - blockX;
+            int cellsY = stepY > 0 ? blockY + blockSize - 1 - mapY : mapY - blockY;
+            float exitX = sideDistX + cellsX * deltaDistX;
+            float exitY = sideDistY + cellsY * deltaDistY;
+
+            // Steps the DDA would take on each axis before leaving. Ties step y
+            // first, as in the single-step loop.
+            int stepsX, stepsY;
+            if (exitX < exitY) {
+                stepsX = cellsX;
+                float crossings = (exitX - sideDistY) / deltaDistY;
+                stepsY = crossings < 0 ? 0 : std::min(int(crossings) + 1, cellsY);
+            } else {
+                stepsY = cellsY;
+                float crossings = (exitY - sideDistX) / deltaDistX;
+                stepsX = crossings <= 0 ? 0 : std::min(int(std::ceil(crossings)), cellsX);
+            }
+            mapX += stepsX * stepX;
+            mapY += stepsY * stepY;
+            sideDistX += stepsX * deltaDistX;
+            sideDistY += stepsY * deltaDistY;
+        }
+
+        // The next step crosses the nearer edge, min(sideDistX, sideDistY) away
+        if (std::min(sideDistX, sideDistY) > p.maxDistance) {
+            storeMiss(p, hits, x, mapX, mapY);
+            return;
+        }
+
+        // Jump to next map square
+        if (sideDistX < sideDistY) {
+            sideDistX += deltaDistX;
+            mapX += stepX;
+            side = 0;
+        } else {
+            sideDistY += deltaDistY;
+            mapY += stepY;
+            side = 1;
+        }
+
+        // Check if ray hit a wall
+        if (mapSolid(p.solid, mapX, mapY, p.mapChunksY)) {
+            break;
+        }
+    }
+
+    hits.perpWallDist[x] = (side == 0) ? sideDistX - deltaDistX : sideDistY - deltaDistY;
+    hits.side[x] = side;
+    hits.mapX[x] = mapX;
+    hits.mapY[x] = mapY;
+}
+
+#ifdef RAYCAST_X86_SIMD
+
+// Trace columns x..x+3 together. Lanes step independently under a mask and
+// retire (stop updating) as soon as they hit a wall.
+__attribute__((target("sse4.1")))
+inline void castRaysSSE(const RayCastParams& p, RayHits& hits, int x) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 farAway = _mm_set1_ps(1e30f);
+
+    __m128 rayDirX = _mm_loadu_ps(&hits.rayDirX[x]);
+    __m128 rayDirY = _mm_loadu_ps(&hits.rayDirY[x]);
+
+    int startX = int(p.posX);
+    int startY = int(p.posY);
+    __m128i mapX = _mm_set1_epi32(startX);
+    __m128i mapY = _mm_set1_epi32(startY);
+    __m128 posX = _mm_set1_ps(p.posX);
+    __m128 posY = _mm_set1_ps(p.posY);
+    __m128 cellX = _mm_set1_ps(float(startX));
+    __m128 cellY = _mm_set1_ps(float(startY));
+
+    __m128 deltaDistX = _mm_blendv_ps(_mm_andnot_ps(signMask, _mm_div_ps(one, rayDirX)), farAway, _mm_cmpeq_ps(rayDirX, zero));
+    __m128 deltaDistY = _mm_blendv_ps(_mm_andnot_ps(signMask, _mm_div_ps(one, rayDirY)), farAway, _mm_cmpeq_ps(rayDirY, zero));
+
+    __m128 negX = _mm_cmplt_ps(rayDirX, zero);
+    __m128 negY = _mm_cmplt_ps(rayDirY, zero);
+    __m128i stepX = _mm_or_si128(_mm_castps_si128(negX), _mm_set1_epi32(1));  // -1 or 1
+    __m128i stepY = _mm_or_si128(_mm_castps_si128(negY), _mm_set1_epi32(1));
+    __m128 sideDistX = _mm_blendv_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(cellX, one), posX), deltaDistX),
+                                     _mm_mul_ps(_mm_sub_ps(posX, cellX), deltaDistX), negX);
+    __m128 sideDistY = _mm_blendv_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(cellY, one), posY), deltaDistY),
+                                     _mm_mul_ps(_mm_sub_ps(posY, cellY), deltaDistY), negY);
+
+    // Distance budget of each lane, as in stepBudget()
+    const __m128 maxDistance = _mm_set1_ps(p.maxDistance);
+    __m128i steps = _mm_add_epi32(
+        _mm_and_si128(_mm_castps_si128(_mm_cmple_ps(sideDistX, maxDistance)),
+                      _mm_add_epi32(_mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(maxDistance, sideDistX), deltaDistX)), _mm_set1_epi32(1))),
+        _mm_and_si128(_mm_castps_si128(_mm_cmple_ps(sideDistY, maxDistance)),
+                      _mm_add_epi32(_mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(maxDistance, sideDistY), deltaDistY)), _mm_set1_epi32(1))));
+
+    __m128i side = _mm_setzero_si128();
+    __m128i active = _mm_cmpgt_epi32(steps, _mm_setzero_si128());
+    __m128i hitLanes = _mm_setzero_si128();
+
+    while (_mm_movemask_ps(_mm_castsi128_ps(active))) {
+        // Jump to next map square in every live lane
+        __m128i takeX = _mm_castps_si128(_mm_cmplt_ps(sideDistX, sideDistY));
+        __m128i moveX = _mm_and_si128(active, takeX);
+        __m128i moveY = _mm_andnot_si128(takeX, active);
+        sideDistX = _mm_blendv_ps(sideDistX, _mm_add_ps(sideDistX, deltaDistX), _mm_castsi128_ps(moveX));
+        sideDistY = _mm_blendv_ps(sideDistY, _mm_add_ps(sideDistY, deltaDistY), _mm_castsi128_ps(moveY));
+        mapX = _mm_add_epi32(mapX, _mm_and_si128(stepX, moveX));
+        mapY = _mm_add_epi32(mapY, _mm_and_si128(stepY, moveY));
+        side = _mm_blendv_epi8(side, _mm_setzero_si128(), moveX);
+        side = _mm_blendv_epi8(side, _mm_set1_epi32(1), moveY);
+
+        steps = _mm_sub_epi32(steps, _mm_set1_epi32(1));
+
+        // Check which live lanes hit a wall; retire those and the ones out of budget
+        int probe = _mm_movemask_ps(_mm_castsi128_ps(active));
+        alignas(16) int laneX[4], laneY[4];
+        _mm_store_si128((__m128i*)laneX, mapX);
+        _mm_store_si128((__m128i*)laneY, mapY);
+        alignas(16) int cell[4] = {0, 0, 0, 0};
+        for (int lane = 0; lane < 4; lane++) {
+            if (probe & (1 << lane)) cell[lane] = mapSolid(p.solid, laneX[lane], laneY[lane], p.mapChunksY);
+        }
+        __m128i hit = _mm_and_si128(active, _mm_cmpgt_epi32(_mm_load_si128((const __m128i*)cell), _mm_setzero_si128()));
+        hitLanes = _mm_or_si128(hitLanes, hit);
+        active = _mm_and_si128(_mm_andnot_si128(hit, active), _mm_cmpgt_epi32(steps, _mm_setzero_si128()));
+    }
+
+    __m128 sideY = _mm_castsi128_ps(_mm_cmpeq_epi32(side, _mm_set1_epi32(1)));
+    __m128 perpWallDist = _mm_blendv_ps(_mm_sub_ps(sideDistX, deltaDistX), _mm_sub_ps(sideDistY, deltaDistY), sideY);
+    _mm_storeu_ps(&hits.perpWallDist[x], _mm_blendv_ps(maxDistance, perpWallDist, _mm_castsi128_ps(hitLanes)));
+    _mm_storeu_si128((__m128i*)&hits.side[x], _mm_blendv_epi8(_mm_set1_epi32(RAY_MISS), side, hitLanes));
+    _mm_storeu_si128((__m128i*)&hits.mapX[x], mapX);
+    _mm_storeu_si128((__m128i*)&hits.mapY[x], mapY);
+}
+
+// mortonSpread() in each of eight lanes
+__attribute__((target("avx2")))
+inline __m256i mortonSpreadAVX2(__m256i v) {
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 4)), _mm256_set1_epi32(0x0F0F));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 2)), _mm256_set1_epi32(0x3333));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 1)), _mm256_set1_epi32(0x5555));
+    return v;
+}
+
+// Occupancy bits of eight lanes (1 = solid), zero where probe is clear.
+// Computes mapCellBit() per lane and gathers the word holding each bit.
+__attribute__((target("avx2")))
+inline __m256i gatherCellsAVX2(const uint32_t* solid, int chunksY, __m256i mapX, __m256i mapY, __m256i probe) {
+    const __m256i cellMask = _mm256_set1_epi32(MAP_CHUNK_SIZE - 1);
+    mapX = _mm256_add_epi32(mapX, _mm256_set1_epi32(MAP_BORDER));
+    mapY = _mm256_add_epi32(mapY, _mm256_set1_epi32(MAP_BORDER));
+    __m256i chunk = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(mapX, MAP_CHUNK_SHIFT), _mm256_set1_epi32(chunksY)),
+                                     _mm256_srai_epi32(mapY, MAP_CHUNK_SHIFT));
+    __m256i bit = _mm256_or_si256(_mm256_slli_epi32(chunk, 2 * MAP_CHUNK_SHIFT),
+                                  _mm256_or_si256(_mm256_slli_epi32(mortonSpreadAVX2(_mm256_and_si256(mapX, cellMask)), 1),
+                                                  mortonSpreadAVX2(_mm256_and_si256(mapY, cellMask))));
+    __m256i word = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)solid,
+                                               _mm256_srli_epi32(bit, 5), probe, 4);
+    __m256i shift = _mm256_and_si256(bit, _mm256_set1_epi32(31));
+    return _mm256_and_si256(_mm256_srlv_epi32(word, shift), _mm256_set1_epi32(1));
+}
+
+// Trace columns x..x+7 together, gathering map cells with AVX2
+__attribute__((target("avx2")))
+inline void castRaysAVX2(const RayCastParams& p, RayHits& hits, int x) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 farAway = _mm256_set1_ps(1e30f);
+
+    __m256 rayDirX = _mm256_loadu_ps(&hits.rayDirX[x]);
+    __m256 rayDirY = _mm256_loadu_ps(&hits.rayDirY[x]);
+
+    int startX = int(p.posX);
+    int startY = int(p.posY);
+    __m256i mapX = _mm256_set1_epi32(startX);
+    __m256i mapY = _mm256_set1_epi32(startY);
+    __m256 posX = _mm256_set1_ps(p.posX);
+    __m256 posY = _mm256_set1_ps(p.posY);
+    __m256 cellX = _mm256_set1_ps(float(startX));
+    __m256 cellY = _mm256_set1_ps(float(startY));
+
+    __m256 deltaDistX = _mm256_blendv_ps(_mm256_andnot_ps(signMask, _mm256_div_ps(one, rayDirX)), farAway,
+                                         _mm256_cmp_ps(rayDirX, zero, _CMP_EQ_OQ));
+    __m256 deltaDistY = _mm256_blendv_ps(_mm256_andnot_ps(signMask, _mm256_div_ps(one, rayDirY)), farAway,
+                                         _mm256_cmp_ps(rayDirY, zero, _CMP_EQ_OQ));
+
+    __m256 negX = _mm256_cmp_ps(rayDirX, zero, _CMP_LT_OQ);
+    __m256 negY = _mm256_cmp_ps(rayDirY, zero, _CMP_LT_OQ);
+    __m256i stepX = _mm256_or_si256(_mm256_castps_si256(negX), _mm256_set1_epi32(1));
+    __m256i stepY = _mm256_or_si256(_mm256_castps_si256(negY), _mm256_set1_epi32(1));
+    __m256 sideDistX = _mm256_blendv_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(cellX, one), posX), deltaDistX),
+                                        _mm256_mul_ps(_mm256_sub_ps(posX, cellX), deltaDistX), negX);
+    __m256 sideDistY = _mm256_blendv_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(cellY, one), posY), deltaDistY),
+                                        _mm256_mul_ps(_mm256_sub_ps(posY, cellY), deltaDistY), negY);
+
+    // Distance budget of each lane, as in stepBudget()
+    const __m256 maxDistance = _mm256_set1_ps(p.maxDistance);
+    __m256i steps = _mm256_add_epi32(
+        _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(sideDistX, maxDistance, _CMP_LE_OQ)),
+                         _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_div_ps(_mm256_sub_ps(maxDistance, sideDistX), deltaDistX)),
+                                          _mm256_set1_epi32(1))),
+        _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(sideDistY, maxDistance, _CMP_LE_OQ)),
+                         _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_div_ps(_mm256_sub_ps(maxDistance, sideDistY), deltaDistY)),
+                                          _mm256_set1_epi32(1))));
+
+    __m256i side = _mm256_setzero_si256();
+    __m256i active = _mm256_cmpgt_epi32(steps, _mm256_setzero_si256());
+    __m256i hitLanes = _mm256_setzero_si256();
+
+    while (!_mm256_testz_si256(active, active)) {
+        // Jump to next map square in every live lane
+        __m256i takeX = _mm256_castps_si256(_mm256_cmp_ps(sideDistX, sideDistY, _CMP_LT_OQ));
+        __m256i moveX = _mm256_and_si256(active, takeX);
+        __m256i moveY = _mm256_andnot_si256(takeX, active);
+        sideDistX = _mm256_blendv_ps(sideDistX, _mm256_add_ps(sideDistX, deltaDistX), _mm256_castsi256_ps(moveX));
+        sideDistY = _mm256_blendv_ps(sideDistY, _mm256_add_ps(sideDistY, deltaDistY), _mm256_castsi256_ps(moveY));
+        mapX = _mm256_add_epi32(mapX, _mm256_and_si256(stepX, moveX));
+        mapY = _mm256_add_epi32(mapY, _mm256_and_si256(stepY, moveY));
+        side = _mm256_blendv_epi8(side, _mm256_setzero_si256(), moveX);
+        side = _mm256_blendv_epi8(side, _mm256_set1_epi32(1), moveY);
+
+        steps = _mm256_sub_epi32(steps, _mm256_set1_epi32(1));
+
+        // Gather the cells of live lanes; retire the ones that hit a wall and the ones out of budget
+        __m256i cell = gatherCellsAVX2(p.solid, p.mapChunksY, mapX, mapY, active);
+        __m256i hit = _mm256_cmpgt_epi32(cell, _mm256_setzero_si256());
+        hitLanes = _mm256_or_si256(hitLanes, hit);
+        active = _mm256_and_si256(_mm256_andnot_si256(hit, active), _mm256_cmpgt_epi32(steps, _mm256_setzero_si256()));
+    }
+
+    __m256 sideY = _mm256_castsi256_ps(_mm256_cmpeq_epi32(side, _mm256_set1_epi32(1)));
+    __m256 perpWallDist = _mm256_blendv_ps(_mm256_sub_ps(sideDistX, deltaDistX), _mm256_sub_ps(sideDistY, deltaDistY), sideY);
+    _mm256_storeu_ps(&hits.perpWallDist[x], _mm256_blendv_ps(maxDistance, perpWallDist, _mm256_castsi256_ps(hitLanes)));
+    _mm256_storeu_si256((__m256i*)&hits.side[x], _mm256_blendv_epi8(_mm256_set1_epi32(RAY_MISS), side, hitLanes));
+    _mm256_storeu_si256((__m256i*)&hits.mapX[x], mapX);
+    _mm256_storeu_si256((__m256i*)&hits.mapY[x], mapY);
+}
+
+// Sixteen-lane versions of mortonSpreadAVX2 and gatherCellsAVX2. The shifts
+// are the zero-masked forms with every lane selected, which GCC doesn't flag
+// as reading an undefined pass-through vector.
+__attribute__((target("avx512f")))
+inline __m512i mortonSpreadAVX512(__m512i v) {
+    const __mmask16 all = 0xFFFF;
+    v = _mm512_and_si512(_mm512_or_si512(v, _mm512_maskz_slli_epi32(all, v, 4)), _mm512_set1_epi32(0x0F0F));
+    v = _mm512_and_si512(_mm512_or_si512(v, _mm512_maskz_slli_epi32(all, v, 2)), _mm512_set1_epi32(0x3333));
+    v = _mm512_and_si512(_mm512_or_si512(v, _mm512_maskz_slli_epi32(all, v, 1)), _mm512_set1_epi32(0x5555));
+    return v;
+}
+
+__attribute__((target("avx512f")))
+inline __m512i gatherCellsAVX512(const uint32_t* solid, int chunksY, __m512i mapX, __m512i mapY, __mmask16 probe) {
+    const __mmask16 all = 0xFFFF;
+    const __m512i cellMask = _mm512_set1_epi32(MAP_CHUNK_SIZE - 1);
+    mapX = _mm512_add_epi32(mapX, _mm512_set1_epi32(MAP_BORDER));
+    mapY = _mm512_add_epi32(mapY, _mm512_set1_epi32(MAP_BORDER));
+    __m512i chunk = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_maskz_srli_epi32(all, mapX, MAP_CHUNK_SHIFT), _mm512_set1_epi32(chunksY)),
+                                     _mm512_maskz_srli_epi32(all, mapY, MAP_CHUNK_SHIFT));
+    __m512i bit = _mm512_or_si512(_mm512_maskz_slli_epi32(all, chunk, 2 * MAP_CHUNK_SHIFT),
+                                  _mm512_or_si512(_mm512_maskz_slli_epi32(all, mortonSpreadAVX512(_mm512_and_si512(mapX, cellMask)), 1),
+                                                  mortonSpreadAVX512(_mm512_and_si512(mapY, cellMask))));
+    __m512i word = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), probe,
+                                               _mm512_maskz_srli_epi32(all, bit, 5), solid, 4);
+    __m512i shift = _mm512_and_si512(bit, _mm512_set1_epi32(31));
+    return _mm512_and_si512(_mm512_maskz_srlv_epi32(all, word, shift), _mm512_set1_epi32(1));
+}
+
+// Trace columns x..x+15 together using AVX-512 mask registers for lane retirement
+__attribute__((target("avx512f")))
+inline void castRaysAVX512(const RayCastParams& p, RayHits& hits, int x) {
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 farAway = _mm512_set1_ps(1e30f);
+
+    __m512 rayDirX = _mm512_loadu_ps(&hits.rayDirX[x]);
+    __m512 rayDirY = _mm512_loadu_ps(&hits.rayDirY[x]);
+
+    int startX = int(p.posX);
+    int startY = int(p.posY);
+    __m512i mapX = _mm512_set1_epi32(startX);
+    __m512i mapY = _mm512_set1_epi32(startY);
+    __m512 posX = _mm512_set1_ps(p.posX);
+    __m512 posY = _mm512_set1_ps(p.posY);
+    __m512 cellX = _mm512_set1_ps(float(startX));
+    __m512 cellY = _mm512_set1_ps(float(startY));
+
+    __m512 deltaDistX = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(rayDirX, zero, _CMP_EQ_OQ),
+                                             _mm512_abs_ps(_mm512_div_ps(one, rayDirX)), farAway);
+    __m512 deltaDistY = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(rayDirY, zero, _CMP_EQ_OQ),
+                                             _mm512_abs_ps(_mm512_div_ps(one, rayDirY)), farAway);
+
+    __mmask16 negX = _mm512_cmp_ps_mask(rayDirX, zero, _CMP_LT_OQ);
+    __mmask16 negY = _mm512_cmp_ps_mask(rayDirY, zero, _CMP_LT_OQ);
+    __m512i stepX = _mm512_mask_blend_epi32(negX, _mm512_set1_epi32(1), _mm512_set1_epi32(-1));
+    __m512i stepY = _mm512_mask_blend_epi32(negY, _mm512_set1_epi32(1), _mm512_set1_epi32(-1));
+    __m512 sideDistX = _mm512_mask_blend_ps(negX, _mm512_mul_ps(_mm512_sub_ps(_mm512_add_ps(cellX, one), posX), deltaDistX),
+                                            _mm512_mul_ps(_mm512_sub_ps(posX, cellX), deltaDistX));
+    __m512 sideDistY = _mm512_mask_blend_ps(negY, _mm512_mul_ps(_mm512_sub_ps(_mm512_add_ps(cellY, one), posY), deltaDistY),
+                                            _mm512_mul_ps(_mm512_sub_ps(posY, cellY), deltaDistY));
+
+    // Distance budget of each lane, as in stepBudget()
+    const __mmask16 all = 0xFFFF;
+    const __m512 maxDistance = _mm512_set1_ps(p.maxDistance);
+    const __m512i oneStep = _mm512_set1_epi32(1);
+    __m512i steps = _mm512_add_epi32(
+        _mm512_maskz_add_epi32(_mm512_cmp_ps_mask(sideDistX, maxDistance, _CMP_LE_OQ),
+                               _mm512_maskz_cvttps_epi32(all, _mm512_div_ps(_mm512_sub_ps(maxDistance, sideDistX), deltaDistX)), oneStep),
+        _mm512_maskz_add_epi32(_mm512_cmp_ps_mask(sideDistY, maxDistance, _CMP_LE_OQ),
+                               _mm512_maskz_cvttps_epi32(all, _mm512_div_ps(_mm512_sub_ps(maxDistance, sideDistY), deltaDistY)), oneStep));
+
+    __mmask16 sideIsY = 0;
+    __mmask16 active = _mm512_cmpgt_epi32_mask(steps, _mm512_setzero_si512());
+    __mmask16 hitLanes = 0;
+
+    while (active) {
+        // Jump to next map square in every live lane
+        __mmask16 takeX = _mm512_cmp_ps_mask(sideDistX, sideDistY, _CMP_LT_OQ);
+        __mmask16 moveX = active & takeX;
+        __mmask16 moveY = active & ~takeX;
+        sideDistX = _mm512_mask_add_ps(sideDistX, moveX, sideDistX, deltaDistX);
+        sideDistY = _mm512_mask_add_ps(sideDistY, moveY, sideDistY, deltaDistY);
+        mapX = _mm512_mask_add_epi32(mapX, moveX, mapX, stepX);
+        mapY = _mm512_mask_add_epi32(mapY, moveY, mapY, stepY);
+        sideIsY = (sideIsY & ~active) | moveY;
+
+        steps = _mm512_sub_epi32(steps, oneStep);
+
+        // Gather the cells of live lanes; retire the ones that hit a wall and the ones out of budget
+        __m512i cell = gatherCellsAVX512(p.solid, p.mapChunksY, mapX, mapY, active);
+        __mmask16 hit = _mm512_mask_cmpgt_epi32_mask(active, cell, _mm512_setzero_si512());
+        hitLanes |= hit;
+        active = (active & ~hit) & _mm512_cmpgt_epi32_mask(steps, _mm512_setzero_si512());
+    }
+
+    __m512 perpWallDist = _mm512_mask_blend_ps(sideIsY, _mm512_sub_ps(sideDistX, deltaDistX), _mm512_sub_ps(sideDistY, deltaDistY));
+    _mm512_storeu_ps(&hits.perpWallDist[x], _mm512_mask_blend_ps(hitLanes, maxDistance, perpWallDist));
+    _mm512_storeu_si512(&hits.side[x], _mm512_mask_blend_epi32(hitLanes, _mm512_set1_epi32(RAY_MISS),
+                                                               _mm512_maskz_mov_epi32(sideIsY, oneStep)));
+    _mm512_storeu_si512(&hits.mapX[x], mapX);
+    _mm512_storeu_si512(&hits.mapY[x], mapY);
+}
+
+#endif // RAYCAST_X86_SIMD
+
+// Widest packet this CPU can run: 16, 8, 4, or 1 for the scalar kernel
+inline int detectRayPacketWidth() {
+#ifdef RAYCAST_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return 16;
+    if (__builtin_cpu_supports("avx2")) return 8;
+    if (__builtin_cpu_supports("sse4.1")) return 4;
+#endif
+    return 1;
+}
+
+// Clamp a requested packet width to one that exists and this CPU supports
+inline int selectRayPacketWidth(int requested) {
+    int best = detectRayPacketWidth();
+    int width = 1;
+    for (int candidate = 16; candidate > 1; candidate /= 2) {
+        if (candidate <= requested && candidate <= best) {
+            width = candidate;
+            break;
+        }
+    }
+    return width;
+}
+
+// Cast columns [begin, end) in packets of the given width, finishing the
+// columns that don't fill a whole packet with the scalar kernel. A camera
+// outside the map sees nothing but fog. With an
+// occupancy pyramid every ray leaps on its own instead; lanes of a packet
+// would diverge after the first leap.
+inline void castRays(const RayCastParams& p, RayHits& hits, int begin, int end, int packetWidth) {
+    // The border only stops rays that start inside the map
+    if (!(p.posX >= 0 && p.posY >= 0 && p.posX < p.mapWidth && p.posY < p.mapHeight)) {
+        for (int x = begin; x < end; x++) {
+            storeMiss(p, hits, x, int(p.posX), int(p.posY));
+        }
+        return;
+    }
+    if (p.pyramid) {
+        for (int x = begin; x < end; x++) {
+            castRayHierarchical(p, hits, x);
+        }
+        return;
+    }
+    int x = begin;
+#ifdef RAYCAST_X86_SIMD
+    if (packetWidth == 16) {
+        for (; x + 16 <= end; x += 16) castRaysAVX512(p, hits, x);
+    } else if (packetWidth == 8) {
+        for (; x + 8 <= end; x += 8) castRaysAVX2(p, hits, x);
+    } else if (packetWidth == 4) {
+        for (; x + 4 <= end; x += 4) castRaysSSE(p, hits, x);
+    }
+#endif
+    for (; x < end; x++) {
+        castRayScalar(p, hits, x);
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Dynamic resolution: picks the scale the 3D view is rendered at so that its
+// measured cost stays inside a per-frame budget. The scale moves in steps of
+// 1/RESOLUTION_STEPS between full resolution and RESOLUTION_MIN_SCALE.
+// Stepping down needs the smoothed cost over budget for a few frames in a row;
+// stepping up needs the cost predicted at the next step to fit with a margin,
+// for much longer. The gap between the two keeps the scale from flickering
+// back and forth around the budget.
+
+const int RESOLUTION_STEPS = 8;           // Scale is (RESOLUTION_STEPS - level) / RESOLUTION_STEPS
+const int RESOLUTION_MAX_LEVEL = 4;       // Lowest scale: half resolution
+const int RESOLUTION_DOWN_FRAMES = 3;     // Frames over budget before stepping down
+const int RESOLUTION_UP_FRAMES = 30;      // Frames with headroom before stepping up
+const double RESOLUTION_UP_MARGIN = 0.85; // Next step up must be predicted to fit in this share of the budget
+const double RESOLUTION_SMOOTHING = 0.2;  // Weight of the newest frame in the smoothed cost
+
+class ResolutionController {
+private:
+    double budgetMs;     // 0 = disabled
+    bool scaleHeight;    // Scale both dimensions, or only the ray count
+    int level;
+    double smoothedMs;   // 0 until the first frame at the current level
+    int overFrames;
+    int underFrames;
+
+    // Cost follows the pixel count: the square of the scale when both
+    // dimensions change, the scale itself when only the width does
+    double predictedCost(int target) const {
+        double ratio = scaleAt(target) / scaleAt(level);
+        return smoothedMs * (scaleHeight ? ratio * ratio : ratio);
+    }
+
+    void setLevel(int newLevel) {
+        level = newLevel;
+        overFrames = 0;
+        underFrames = 0;
+        smoothedMs = 0;  // Measurements at the old scale say little about the new one
+    }
+
+public:
+    ResolutionController() : budgetMs(0), scaleHeight(true), level(0), smoothedMs(0),
+                             overFrames(0), underFrames(0) {}
+
+    // Target cost per frame in milliseconds; 0 turns scaling off and returns to full resolution
+    void setBudget(double ms, bool scaleBoth) {
+        budgetMs = ms;
+        scaleHeight = scaleBoth;
+        setLevel(0);
+    }
+
+    bool isEnabled() const { return budgetMs > 0; }
+    double getBudget() const { return budgetMs; }
+    bool scalesHeight() const { return scaleHeight; }
+    int getLevel() const { return level; }
+
+    static float scaleAt(int level) {
+        return float(RESOLUTION_STEPS - level) / RESOLUTION_STEPS;
+    }
+
+    float getScale() const { return scaleAt(level); }
+
+    // Feed the cost of the frame just rendered. Returns true when the scale changed.
+    bool update(double frameMs) {
+        if (!isEnabled()) return false;
+        smoothedMs = smoothedMs > 0 ? smoothedMs + (frameMs - smoothedMs) * RESOLUTION_SMOOTHING : frameMs;
+
+        if (smoothedMs > budgetMs) {
+            overFrames++;
+            underFrames = 0;
+        } else if (level > 0 && predictedCost(level - 1) < budgetMs * RESOLUTION_UP_MARGIN) {
+            underFrames++;
+            overFrames = 0;
+        } else {
+            overFrames = 0;
+            underFrames = 0;
+        }
+
+        if (overFrames >= RESOLUTION_DOWN_FRAMES && level < RESOLUTION_MAX_LEVEL) {
+            setLevel(level + 1);
+            return true;
+        }
+        if (underFrames >= RESOLUTION_UP_FRAMES) {
+            setLevel(level - 1);
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+// Fixed-timestep simulation on a thread of its own. The simulation thread
+// runs Game::update() at a steady tick rate and, after every tick, publishes
+// a snapshot of what rendering needs (SimSnapshot). The render thread never
+// waits for it: it takes the newest snapshot when there is one and draws
+// between the last two, so motion stays smooth at any frame rate and the
+// game runs at the same speed however fast or slow frames are drawn.
+//
+// Snapshots change hands through a triple buffer: the simulation fills one
+// slot while the renderer holds another, and the third is swapped between
+// them with a single atomic exchange, so neither side ever blocks. Input goes
+// the other way through a mailbox of atomics.
+//
+// While the thread runs it owns the game's state; the render side only calls
+// SimulationThread::render(). Stop the thread before loading or generating a
+// level, respawning enemies or editing the map.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include "engine.h"
+#include "demo.h"
+
+const int DEFAULT_TICK_RATE = 60;     // Simulation ticks per second
+const int MAX_CATCH_UP_TICKS = 5;     // Ticks run back to back after a stall before the schedule is reset
+
+// Input from the window thread, waiting for the next tick. Held keys are
+// whatever was posted last; turns add up until a tick takes them, and a shot
+// posted between two ticks is kept until one does, so nothing is lost when
+// frames come faster than ticks.
+class InputMailbox {
+private:
+    enum {
+        FORWARD = 1,
+        BACKWARD = 2,
+        STRAFE_LEFT = 4,
+        STRAFE_RIGHT = 8,
+        FIRE = 16
+    };
+
+    std::atomic<uint32_t> held;
+    std::atomic<bool> fired;
+    std::atomic<float> turn;
+
+public:
+    InputMailbox() : held(0), fired(false), turn(0.0f) {}
+
+    void post(const InputState& input) {
+        uint32_t keys = (input.forward ? FORWARD : 0) | (input.backward ? BACKWARD : 0) |
+                        (input.strafeLeft ? STRAFE_LEFT : 0) | (input.strafeRight ? STRAFE_RIGHT : 0) |
+                        (input.fire ? FIRE : 0);
+        held.store(keys, std::memory_order_relaxed);
+        if (input.fire) fired.store(true, std::memory_order_relaxed);
+        if (input.turn != 0.0f) {
+            float current = turn.load(std::memory_order_relaxed);
+            while (!turn.compare_exchange_weak(current, current + input.turn, std::memory_order_relaxed)) {}
+        }
+    }
+
+    // Input for one tick; empties the turn and shot accumulated so far
+    InputState take() {
+        InputState input;
+        uint32_t keys = held.load(std::memory_order_relaxed);
+        input.forward = (keys & FORWARD) != 0;
+        input.backward = (keys & BACKWARD) != 0;
+        input.strafeLeft = (keys & STRAFE_LEFT) != 0;
+        input.strafeRight = (keys & STRAFE_RIGHT) != 0;
+        input.fire = fired.exchange(false, std::memory_order_relaxed) || (keys & FIRE) != 0;
+        input.turn = turn.exchange(0.0f, std::memory_order_relaxed);
+        return input;
+    }
+};
+
+// Lock-free triple buffer of snapshots, one writer and one reader
+class SnapshotExchange {
+private:
+    static const int FRESH = 4;  // Set in middle when it holds a snapshot the reader hasn't taken
+    static const int SLOT = 3;
+
+    SimSnapshot slots[3];
+    int writing;                 // Writer's slot
+    int reading;                 // Reader's slot
+    std::atomic<int> middle;     // Slot between them, and FRESH
+
+public:
+    SnapshotExchange() : writing(0), reading(1), middle(2) {}
+
+    // Slot the writer fills next
+    SimSnapshot& writeSlot() { return slots[writing]; }
+
+    // Hand the filled slot to the reader, replacing any snapshot it hasn't taken yet
+    void publish() {
+        writing = middle.exchange(writing | FRESH, std::memory_order_acq_rel) & SLOT;
+    }
+
+    // The newest published snapshot, or NULL if none arrived since the last call.
+    // It stays valid until the next call.
+    const SimSnapshot* acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return NULL;
+        reading = middle.exchange(reading, std::memory_order_acq_rel) & SLOT;
+        return &slots[reading];
+    }
+};
+
+class SimulationThread {
+private:
+    Game& game;
+    std::chrono::steady_clock::duration period;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<long long> ticks;
+    InputMailbox input;
+    SnapshotExchange snapshots;
+    Demo* recording;   // Ticks are appended here, if set
+
+    // Render side: the two newest snapshots it has taken
+    SimSnapshot previous, current;
+
+    static double seconds(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double>(t.time_since_epoch()).count();
+    }
+
+    void loop() {
+        PROFILE_THREAD("simulation");
+        auto next = std::chrono::steady_clock::now();
+        long long tick = ticks.load(std::memory_order_relaxed);
+        while (running.load(std::memory_order_acquire)) {
+            {
+                PROFILE_SCOPE("tick");
+                InputState tickInput = input.take();
+                game.update(tickInput);
+                if (recording) recording->record(tickInput, game.stateChecksum());
+                PROFILE_SCOPE("snapshot");
+                SimSnapshot& snapshot = snapshots.writeSlot();
+                game.captureSnapshot(snapshot);
+                snapshot.tick = ++tick;
+                snapshot.time = seconds(std::chrono::steady_clock::now());
+                snapshots.publish();
+                ticks.store(tick, std::memory_order_relaxed);
+            }
+
+            // Ticks missed by a short stall run back to back to keep game time on
+            // schedule; after a long one the schedule restarts from now instead
+            next += period;
+            auto now = std::chrono::steady_clock::now();
+            if (now - next > period * MAX_CATCH_UP_TICKS) next = now;
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+public:
+    SimulationThread(Game& target, int tickRate = DEFAULT_TICK_RATE)
+        : game(target), running(false), ticks(0), recording(NULL) {
+        setTickRate(tickRate);
+    }
+
+    ~SimulationThread() { stop(); }
+
+    // Ticks per second; takes effect the next time the thread starts
+    void setTickRate(int tickRate) {
+        tickRate = std::max(1, tickRate);
+        period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / tickRate));
+    }
+
+    double getTickPeriod() const { return std::chrono::duration<double>(period).count(); }
+
+    // Start ticking. Both snapshots the renderer starts from are the game as it
+    // is now, so the first frames show it standing still.
+    void start() {
+        if (running.load(std::memory_order_relaxed)) return;
+        game.captureSnapshot(current);
+        current.tick = ticks.load(std::memory_order_relaxed);
+        current.time = seconds(std::chrono::steady_clock::now());
+        previous = current;
+        running.store(true, std::memory_order_release);
+        thread = std::thread(&SimulationThread::loop, this);
+    }
+
+    // Stop after the tick in progress; the game is the caller's again afterwards
+    void stop() {
+        if (!running.load(std::memory_order_relaxed)) return;
+        running.store(false, std::memory_order_release);
+        thread.join();
+    }
+
+    bool isRunning() const { return running.load(std::memory_order_relaxed); }
+
+    // Record every tick's input into demo (NULL stops recording). Only while
+    // stopped; the demo is the simulation thread's until the next stop().
+    void setRecording(Demo* demo) { recording = demo; }
+
+    // Ticks simulated so far
+    long long getTicks() const { return ticks.load(std::memory_order_relaxed); }
+
+    // Input for the coming ticks, from the thread that renders
+    void postInput(const InputState& state) { input.post(state); }
+
+    // Render a frame between the two newest snapshots. It is drawn one tick
+    // behind the simulation, so there is always a later snapshot to blend
+    // toward. Returns Game::render()'s result.
+    bool render() {
+        const SimSnapshot* latest = snapshots.acquire();
+        if (latest) {
+            std::swap(previous, current);
+            current = *latest;
+        }
+        double now = seconds(std::chrono::steady_clock::now()) - getTickPeriod();
+        double span = current.time - previous.time;
+        float alpha = span > 0 ? float((now - previous.time) / span) : 1.0f;
+        return game.renderInterpolated(previous, current, alpha);
+    }
+
+    // Newest snapshot the renderer has taken
+    const SimSnapshot& latest() const { return current; }
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+// Persistent worker pool for splitting a frame's independent work (columns,
+// rows) across cores. Workers are created once and sleep between jobs, so a
+// parallel pass costs a wake-up rather than a thread launch.
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include "profiler.h"
+
+class ThreadPool {
+private:
+    // Chunk indices owned by one worker. Padded to a cache line so workers
+    // claiming chunks don't bounce each other's counters around.
+    struct alignas(64) WorkRange {
+        std::atomic<int> next;
+        int end;
+    };
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<WorkRange[]> ranges;
+    int rangeCount;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int, int)>* task;
+    int chunkSize;
+    int itemCount;
+    int generation;
+    int busyWorkers;
+    bool stopping;
+
+    // Run chunks from our own range first, then steal from the other workers'
+    // ranges until every chunk of the job has been claimed
+    void runChunks(int self) {
+        for (int k = 0; k < rangeCount; k++) {
+            WorkRange& range = ranges[(self + k) % rangeCount];
+            while (true) {
+                int chunk = range.next.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= range.end) break;
+                int begin = chunk * chunkSize;
+                (*task)(begin, std::min(begin + chunkSize, itemCount));
+            }
+        }
+    }
+
+    void workerLoop(int self) {
+        PROFILE_THREAD("render worker " + std::to_string(self));
+        int seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+
+            runChunks(self);
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (--busyWorkers == 0) done.notify_one();
+        }
+    }
+
+public:
+    // threads is the total number of workers, including the calling thread
+    explicit ThreadPool(int threads)
+        : rangeCount(std::max(threads, 1)), task(NULL), chunkSize(1), itemCount(0),
+          generation(0), busyWorkers(0), stopping(false) {
+        ranges.reset(new WorkRange[rangeCount]);
+        for (int i = 0; i < rangeCount; i++) {
+            ranges[i].next = 0;
+            ranges[i].end = 0;
+        }
+        for (int i = 1; i < rangeCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    int size() const { return rangeCount; }
+
+    // Call fn(begin, end) over [0, count) in chunks of chunk items. Each worker
+    // starts on its own contiguous share of the chunks and steals from the
+    // others when it runs dry. Returns once every chunk has finished, so the
+    // call doubles as a barrier.
+    void parallelFor(int count, int chunk, const std::function<void(int, int)>& fn) {
+        chunk = std::max(chunk, 1);
+        if (workers.empty() || count <= chunk) {
+            if (count > 0) fn(0, count);
+            return;
+        }
+
+        int chunks = (count + chunk - 1) / chunk;
+        for (int i = 0; i < rangeCount; i++) {
+            ranges[i].next.store(int(static_cast<long long>(chunks) * i / rangeCount), std::memory_order_relaxed);
+            ranges[i].end = int(static_cast<long long>(chunks) * (i + 1) / rangeCount);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            task = &fn;
+            chunkSize = chunk;
+            itemCount = count;
+            busyWorkers = int(workers.size());
+            generation++;
+        }
+        wake.notify_all();
+
+        // The calling thread works as worker 0
+        runChunks(0);
+
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&] { return busyWorkers == 0; });
+        task = NULL;
+    }
+};
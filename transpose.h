@@ -0,0 +1,54 @@
+#pragma once
+
+// 32-bit pixel block transpose, used to turn the column-major 3D view into
+// the row-major frame that the blit (or a headless sink) expects.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TRANSPOSE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Copy a width x height block of pixels from column-major src (pixel (x, y)
+// at src[x * srcStride + y]) to row-major dst (pixel (x, y) at
+// dst[y * dstStride + x]). Keep blocks small enough that both sides stay in
+// L1; the caller does the cache blocking.
+inline void transposeBlock(const unsigned int* src, int srcStride, unsigned int* dst, int dstStride,
+                           int width, int height) {
+    int x = 0;
+#ifdef TRANSPOSE_SSE2
+    // 4x4 micro-tiles: load four column runs, shuffle, store four row runs
+    for (; x + 4 <= width; x += 4) {
+        const unsigned int* column = src + x * srcStride;
+        int y = 0;
+        for (; y + 4 <= height; y += 4) {
+            __m128i c0 = _mm_loadu_si128((const __m128i*)(column + y));
+            __m128i c1 = _mm_loadu_si128((const __m128i*)(column + srcStride + y));
+            __m128i c2 = _mm_loadu_si128((const __m128i*)(column + 2 * srcStride + y));
+            __m128i c3 = _mm_loadu_si128((const __m128i*)(column + 3 * srcStride + y));
+
+            __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+            __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+            __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+            __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+
+            unsigned int* row = dst + y * dstStride + x;
+            _mm_storeu_si128((__m128i*)row, _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(row + dstStride), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(row + 2 * dstStride), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128((__m128i*)(row + 3 * dstStride), _mm_unpackhi_epi64(t2, t3));
+        }
+        // Rows left over below the last whole micro-tile
+        for (; y < height; y++) {
+            for (int i = 0; i < 4; i++) {
+                dst[y * dstStride + x + i] = src[(x + i) * srcStride + y];
+            }
+        }
+    }
+#endif
+    // Columns left over (or everything, without SSE2)
+    for (; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            dst[y * dstStride + x] = src[x * srcStride + y];
+        }
+    }
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+// Runtime-sized world map, stored in square chunks of MAP_CHUNK_SIZE cells a
+// side, chunk after chunk. Everything that moves through the map (rays,
+// collision, enemy AI) only asks whether a cell is solid, so that is kept
+// apart as one bit per cell: 512 bytes a chunk, eight times denser than the
+// cells themselves. Inside a chunk the bits are in Morton (Z) order, so a 64-bit
+// word holds an 8x8 block and a cache line a 16x32 one, and a ray's next cells
+// are mostly in lines it has already loaded whichever way it goes. The cell
+// bytes (0 = empty, otherwise the wall's texture) are a side table, one 4 KB
+// page a chunk, only read to texture a wall that was hit.
+//
+// Maps are either generated in memory or mapped straight from a map file: the
+// file is laid out exactly like memory, so loading is a single mmap whatever
+// the map size, and the OS pages chunks in the first time a ray, an enemy or
+// the player touches them. Mapped files are copy-on-write, so runtime edits
+// never reach the disk.
+//
+// Around the map runs a border of MAP_BORDER solid cells, part of the stored
+// grid and kept solid whatever a map file says. A ray that starts inside the
+// map always hits something before it can leave the storage, so the casting
+// kernels test cells without any bounds checks.
+//
+// Map file: a MAP_FILE_HEADER_SIZE header (MapFileHeader, zero padded), the
+// occupancy bits of every chunk padded to a whole page, then the cell bytes of
+// every chunk, border included. Chunk (cx, cy) is at index cx * chunksY + cy in
+// both sections.
+// Little-endian.
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const int MAP_CHUNK_SHIFT = 6;
+const int MAP_CHUNK_SIZE = 1 << MAP_CHUNK_SHIFT;           // Cells per chunk side
+const int MAP_CHUNK_CELLS = MAP_CHUNK_SIZE * MAP_CHUNK_SIZE; // Cell bytes per chunk: one page
+const int MAP_CHUNK_WORDS = MAP_CHUNK_CELLS / 32;          // 32-bit words of occupancy bits per chunk
+const int MAP_BORDER = 1;                                  // Solid cells stored around every side of the map
+const int MAP_PAGE_SIZE = 4096;
+const int MAP_FILE_HEADER_SIZE = MAP_PAGE_SIZE;            // Keeps both sections page-aligned in the file
+const char MAP_FILE_MAGIC[8] = { 'R', 'C', 'M', 'A', 'P', '0', '3', 0 };
+
+// The casting kernels address cells with 32-bit offsets
+const long long MAP_MAX_CELLS = 1LL << 31;
+
+struct MapFileHeader {
+    char magic[8];
+    uint32_t width, height;
+    uint32_t chunkShift;  // Must be MAP_CHUNK_SHIFT
+    float spawnX, spawnY; // Where the player starts
+};
+
+// Chunks along a side of a map `cells` cells long, border included
+inline long long mapChunksFor(long long cells) {
+    return (cells + 2 * MAP_BORDER + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+}
+
+// Offset of cell (x, y)'s byte in a chunked map chunksY chunks tall. The
+// border cells, from -MAP_BORDER up to the size, are valid too.
+inline int mapCellOffset(int x, int y, int chunksY) {
+    x += MAP_BORDER;
+    y += MAP_BORDER;
+    int chunk = (x >> MAP_CHUNK_SHIFT) * chunksY + (y >> MAP_CHUNK_SHIFT);
+    return (chunk << (2 * MAP_CHUNK_SHIFT)) | ((x & (MAP_CHUNK_SIZE - 1)) << MAP_CHUNK_SHIFT) | (y & (MAP_CHUNK_SIZE - 1));
+}
+
+// Spread the low six bits of v to the even bit positions
+inline int mortonSpread(int v) {
+    v = (v | (v << 4)) & 0x0F0F;
+    v = (v | (v << 2)) & 0x3333;
+    v = (v | (v << 1)) & 0x5555;
+    return v;
+}
+
+// mortonSpread() of every in-chunk coordinate, so the per-step lookups in the
+// scalar kernels are one L1 load each rather than six shifts and masks
+struct MortonTable {
+    uint16_t spread[MAP_CHUNK_SIZE];
+    MortonTable() {
+        for (int v = 0; v < MAP_CHUNK_SIZE; v++) spread[v] = uint16_t(mortonSpread(v));
+    }
+};
+static const MortonTable mortonTable;
+
+// Index of cell (x, y)'s occupancy bit: the chunk, then the Morton code of the
+// cell inside it, y in the even bits and x in the odd ones. Shared with the
+// casting kernels, which compute the same thing a packet at a time.
+inline int mapCellBit(int x, int y, int chunksY) {
+    x += MAP_BORDER;
+    y += MAP_BORDER;
+    int chunk = (x >> MAP_CHUNK_SHIFT) * chunksY + (y >> MAP_CHUNK_SHIFT);
+    return (chunk << (2 * MAP_CHUNK_SHIFT)) | (mortonTable.spread[x & (MAP_CHUNK_SIZE - 1)] << 1) |
+           mortonTable.spread[y & (MAP_CHUNK_SIZE - 1)];
+}
+
+// Whether cell (x, y) is solid, from the occupancy bits
+inline bool mapSolid(const uint32_t* bits, int x, int y, int chunksY) {
+    int bit = mapCellBit(x, y, chunksY);
+    return (bits[bit >> 5] >> (bit & 31)) & 1;
+}
+
+class WorldMap {
+private:
+    int width, height;
+    int chunksX, chunksY;
+    uint32_t* bits;           // Chunk-major occupancy bits, owned or mapped
+    uint8_t* cells;           // Chunk-major cell bytes, owned or mapped
+    std::vector<uint32_t> ownedBits;
+    std::vector<uint8_t> ownedCells;
+    float spawnX, spawnY;
+
+    // File mapping behind cells, if the map was loaded
+    void* mapped;
+    size_t mappedBytes;
+#ifdef _WIN32
+    HANDLE mappingHandle;
+#endif
+
+    void unmap() {
+        if (!mapped) return;
+#ifdef _WIN32
+        UnmapViewOfFile(mapped);
+        CloseHandle(mappingHandle);
+#else
+        munmap(mapped, mappedBytes);
+#endif
+        mapped = NULL;
+        mappedBytes = 0;
+    }
+
+    void setSize(int w, int h) {
+        width = w;
+        height = h;
+        chunksX = int(mapChunksFor(w));
+        chunksY = int(mapChunksFor(h));
+    }
+
+    size_t chunkCount() const { return size_t(chunksX) * chunksY; }
+
+    // Bytes of the file's bit section for a map of `chunks` chunks
+    static unsigned long long bitSectionBytes(unsigned long long chunks) {
+        unsigned long long bytes = chunks * MAP_CHUNK_WORDS * sizeof(uint32_t);
+        return (bytes + MAP_PAGE_SIZE - 1) / MAP_PAGE_SIZE * MAP_PAGE_SIZE;
+    }
+
+    static bool validSize(long long w, long long h) {
+        return w > 0 && h > 0 && mapChunksFor(w) * mapChunksFor(h) * MAP_CHUNK_CELLS <= MAP_MAX_CELLS;
+    }
+
+    // Make every border cell solid, whatever was stored there. Touches only
+    // the chunks along the edges.
+    void sealBorder() {
+        for (int b = 1; b <= MAP_BORDER; b++) {
+            for (int x = -b; x < width + b; x++) {
+                set(x, -b, 1);
+                set(x, height + b - 1, 1);
+            }
+            for (int y = -b; y < height + b; y++) {
+                set(-b, y, 1);
+                set(width + b - 1, y, 1);
+            }
+        }
+    }
+
+public:
+    WorldMap() : width(0), height(0), chunksX(0), chunksY(0), bits(NULL), cells(NULL), spawnX(0), spawnY(0),
+                 mapped(NULL), mappedBytes(0) {}
+
+    ~WorldMap() { unmap(); }
+
+    WorldMap(const WorldMap&) = delete;
+    WorldMap& operator=(const WorldMap&) = delete;
+
+    // An empty in-memory map of w x h cells. Returns false if it is too large.
+    bool create(int w, int h) {
+        if (!validSize(w, h)) return false;
+        unmap();
+        setSize(w, h);
+        ownedBits.assign(chunkCount() * MAP_CHUNK_WORDS, 0);
+        ownedCells.assign(chunkCount() * MAP_CHUNK_CELLS, 0);
+        bits = ownedBits.data();
+        cells = ownedCells.data();
+        sealBorder();
+        spawnX = spawnY = 0;
+        return true;
+    }
+
+    // Map a map file. Nothing is read but the header and the border, which is
+    // resealed in case the file left gaps in it; the other chunks are paged in
+    // on first touch. On failure the current map is left as it was.
+    bool load(const char* path) {
+        MapFileHeader header;
+        void* view = NULL;
+        size_t bytes = 0;
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        DWORD read = 0;
+        if (!GetFileSizeEx(file, &fileSize) || !ReadFile(file, &header, sizeof(header), &read, NULL) ||
+            read != sizeof(header) || !checkHeader(header, (unsigned long long)fileSize.QuadPart)) {
+            CloseHandle(file);
+            return false;
+        }
+        bytes = size_t(fileSize.QuadPart);
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping) return false;
+        view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        if (!view) {
+            CloseHandle(mapping);
+            return false;
+        }
+        unmap();
+        mappingHandle = mapping;
+#else
+        int file = open(path, O_RDONLY);
+        if (file < 0) return false;
+        struct stat info;
+        if (fstat(file, &info) != 0 || pread(file, &header, sizeof(header), 0) != ssize_t(sizeof(header)) ||
+            !checkHeader(header, (unsigned long long)info.st_size)) {
+            close(file);
+            return false;
+        }
+        bytes = size_t(info.st_size);
+        view = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        close(file);
+        if (view == MAP_FAILED) return false;
+        unmap();
+#endif
+        mapped = view;
+        mappedBytes = bytes;
+        ownedBits.clear();
+        ownedBits.shrink_to_fit();
+        ownedCells.clear();
+        ownedCells.shrink_to_fit();
+        setSize(int(header.width), int(header.height));
+        uint8_t* base = static_cast<uint8_t*>(view) + MAP_FILE_HEADER_SIZE;
+        bits = reinterpret_cast<uint32_t*>(base);
+        cells = base + bitSectionBytes(chunkCount());
+        sealBorder();
+        spawnX = header.spawnX;
+        spawnY = header.spawnY;
+        return true;
+    }
+
+    // Whether a header describes a map this build can use, held in a file of fileSize bytes
+    static bool checkHeader(const MapFileHeader& header, unsigned long long fileSize) {
+        if (memcmp(header.magic, MAP_FILE_MAGIC, sizeof(MAP_FILE_MAGIC)) != 0) return false;
+        if (header.chunkShift != uint32_t(MAP_CHUNK_SHIFT)) return false;
+        if (!validSize(header.width, header.height)) return false;
+        // Written this way round so a NaN spawn fails too
+        if (!(header.spawnX >= 0 && header.spawnX < float(header.width) &&
+              header.spawnY >= 0 && header.spawnY < float(header.height))) return false;
+        unsigned long long chunks = mapChunksFor(header.width) * mapChunksFor(header.height);
+        return fileSize >= MAP_FILE_HEADER_SIZE + bitSectionBytes(chunks) + chunks * MAP_CHUNK_CELLS;
+    }
+
+    // Write the map in the file format load() maps
+    bool save(const char* path) const {
+        FILE* file = fopen(path, "wb");
+        if (!file) return false;
+        std::vector<char> header(MAP_FILE_HEADER_SIZE, 0);
+        MapFileHeader fields;
+        memcpy(fields.magic, MAP_FILE_MAGIC, sizeof(MAP_FILE_MAGIC));
+        fields.width = width;
+        fields.height = height;
+        fields.chunkShift = MAP_CHUNK_SHIFT;
+        fields.spawnX = spawnX;
+        fields.spawnY = spawnY;
+        memcpy(header.data(), &fields, sizeof(fields));
+        size_t bitBytes = chunkCount() * MAP_CHUNK_WORDS * sizeof(uint32_t);
+        std::vector<char> padding(size_t(bitSectionBytes(chunkCount())) - bitBytes, 0);
+        size_t cellBytes = chunkCount() * MAP_CHUNK_CELLS;
+        bool ok = fwrite(header.data(), 1, header.size(), file) == header.size() &&
+                  fwrite(bits, 1, bitBytes, file) == bitBytes &&
+                  fwrite(padding.data(), 1, padding.size(), file) == padding.size() &&
+                  fwrite(cells, 1, cellBytes, file) == cellBytes;
+        return fclose(file) == 0 && ok;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getChunksY() const { return chunksY; }
+    bool isMapped() const { return mapped != NULL; }
+
+    // Occupancy bits in chunk order, addressed by mapCellBit(), for the casting kernels
+    const uint32_t* solidBits() const { return bits; }
+
+    bool inside(int x, int y) const { return x >= 0 && y >= 0 && x < width && y < height; }
+
+    // Texture of cell (x, y), 0 if empty. The cell must be inside the map.
+    uint8_t at(int x, int y) const { return cells[mapCellOffset(x, y, chunksY)]; }
+
+    // Whether cell (x, y), which must be inside the map, is a wall
+    bool solid(int x, int y) const { return mapSolid(bits, x, y, chunksY); }
+
+    // Whether something moving through the map may not enter cell (x, y).
+    // Outside the map counts as solid.
+    bool blocked(int x, int y) const { return !inside(x, y) || solid(x, y); }
+
+    // Set cell (x, y)'s texture, keeping its occupancy bit in step. The cell must
+    // be inside the map; only sealBorder() writes the border.
+    void set(int x, int y, uint8_t value) {
+        cells[mapCellOffset(x, y, chunksY)] = value;
+        int bit = mapCellBit(x, y, chunksY);
+        if (value) bits[bit >> 5] |= 1u << (bit & 31);
+        else bits[bit >> 5] &= ~(1u << (bit & 31));
+    }
+
+    float getSpawnX() const { return spawnX; }
+    float getSpawnY() const { return spawnY; }
+
+    void setSpawn(float x, float y) {
+        spawnX = x;
+        spawnY = y;
+    }
+};